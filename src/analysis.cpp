@@ -0,0 +1,154 @@
+#include "analysis.h"
+
+#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+enum class Presence { Missing, Present, Unknown };
+
+Presence join(Presence a, Presence b) { return a == b ? a : Presence::Unknown; }
+
+using EntryKey = std::pair<std::string, std::string>; // registry, key
+
+struct VaultState {
+    bool exists{false};
+    // Presence of every key not listed below: Missing for a vault this script creates,
+    // Unknown for a seeded one or after a store into an unknown registry.
+    Presence fallback{Presence::Missing};
+    std::map<EntryKey, Presence> keys;
+
+    Presence get(const EntryKey &k) const {
+        auto it = keys.find(k);
+        return it == keys.end() ? fallback : it->second;
+    }
+};
+
+// What is known at one point inside a vault block.
+struct FlowState {
+    VaultState vault;
+    std::optional<std::string> registry;
+    bool registryKnown{true}; // false once branches disagree on the active registry
+};
+
+FlowState join(const FlowState &a, const FlowState &b) {
+    FlowState out;
+    out.vault.exists = a.vault.exists;
+    out.vault.fallback = join(a.vault.fallback, b.vault.fallback);
+    std::set<EntryKey> seen;
+    for (const auto &k : a.vault.keys) seen.insert(k.first);
+    for (const auto &k : b.vault.keys) seen.insert(k.first);
+    for (const auto &k : seen) {
+        auto p = join(a.vault.get(k), b.vault.get(k));
+        if (p != out.vault.fallback) out.vault.keys[k] = p;
+    }
+    out.registryKnown = a.registryKnown && b.registryKnown && a.registry == b.registry;
+    if (out.registryKnown) out.registry = a.registry;
+    return out;
+}
+
+// The registry a target resolves to, when that is known without running the script. A
+// target with no registry at all is left to fail at runtime as before.
+std::optional<std::string> target_registry(const Target &t, const FlowState &st) {
+    if (t.registry) return t.registry;
+    if (st.registryKnown) return st.registry;
+    return std::nullopt;
+}
+
+void collect_lines(const std::vector<Statement> &body, std::vector<int> &lines) {
+    for (const auto &s : body) {
+        lines.push_back(s.line);
+        if (s.type == StatementType::If) collect_lines(s.conditional.body, lines);
+    }
+}
+
+std::vector<Statement> walk(std::vector<Statement> body, FlowState &st, PruneReport &report) {
+    std::vector<Statement> out;
+    out.reserve(body.size());
+    for (auto &s : body) {
+        switch (s.type) {
+        case StatementType::Registry:
+            st.registry = s.registryName;
+            st.registryKnown = true;
+            out.push_back(std::move(s));
+            break;
+        case StatementType::Store:
+        case StatementType::Replace: {
+            auto reg = target_registry(s.target, st);
+            if (reg) {
+                st.vault.keys[{*reg, s.target.key}] = Presence::Present;
+            } else {
+                // could have landed in any registry; forget everything about this vault
+                st.vault.keys.clear();
+                st.vault.fallback = Presence::Unknown;
+            }
+            out.push_back(std::move(s));
+            break;
+        }
+        case StatementType::If: {
+            auto reg = target_registry(s.conditional.target, st);
+            auto presence = reg ? st.vault.get({*reg, s.conditional.target.key}) : Presence::Unknown;
+            if (presence == Presence::Unknown) {
+                FlowState taken = st;
+                s.conditional.body = walk(std::move(s.conditional.body), taken, report);
+                st = join(taken, st);
+                out.push_back(std::move(s));
+                break;
+            }
+            report.resolved++;
+            bool cond = (presence == Presence::Present) != s.conditional.isMissing;
+            if (cond) {
+                for (auto &inner : walk(std::move(s.conditional.body), st, report)) out.push_back(std::move(inner));
+            } else {
+                collect_lines(s.conditional.body, report.unreachable);
+            }
+            break;
+        }
+        case StatementType::Note:
+        case StatementType::Secure:
+            out.push_back(std::move(s));
+            break;
+        }
+    }
+    return out;
+}
+}
+
+struct ProgramPruner::State {
+    std::unordered_map<std::string, VaultState> vaults;
+    bool materializeOptional{};
+};
+
+ProgramPruner::ProgramPruner(const std::vector<std::string> &seededVaults, bool materializeOptional)
+    : state_(std::make_unique<State>()) {
+    state_->materializeOptional = materializeOptional;
+    for (const auto &name : seededVaults) {
+        auto &v = state_->vaults[name];
+        v.exists = true;
+        v.fallback = Presence::Unknown;
+    }
+}
+
+ProgramPruner::~ProgramPruner() = default;
+
+PruneReport ProgramPruner::prune(std::vector<VaultBlock> &blocks) {
+    PruneReport report;
+    for (auto &block : blocks) {
+        auto &state = state_->vaults[block.name];
+        // mirrors Interpreter::evaluate_vault: an absent optional vault is skipped untouched
+        if (block.optional && !state.exists && !state_->materializeOptional) continue;
+        state.exists = true;
+        FlowState st;
+        st.vault = std::move(state);
+        block.body = walk(std::move(block.body), st, report);
+        state = std::move(st.vault);
+    }
+    return report;
+}
+
+PruneReport prune_program(std::vector<VaultBlock> &program, const std::vector<std::string> &seededVaults,
+                          bool materializeOptional) {
+    return ProgramPruner(seededVaults, materializeOptional).prune(program);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ast.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PruneReport {
+    std::size_t resolved{};       // if-conditions decided without running the script
+    std::vector<int> unreachable; // lines of statements dropped with a false branch
+};
+
+// Dataflow pass over the program that tracks, per vault, which (registry, key) pairs are
+// known present or missing. A vault the script creates starts empty; vaults named in
+// `seededVaults` come from a --load archive and start unknown. Conditions whose outcome is
+// known are replaced by their body (true) or removed (false), so the interpreter only
+// evaluates checks that genuinely depend on the seed.
+PruneReport prune_program(std::vector<VaultBlock> &program, const std::vector<std::string> &seededVaults,
+                          bool materializeOptional);
+
+// prune_program over a program that arrives in pieces: what is known about each vault at the
+// end of one piece carries into the next, so pruning piece by piece gives the same result as
+// pruning the whole program at once.
+class ProgramPruner {
+  public:
+    ProgramPruner(const std::vector<std::string> &seededVaults, bool materializeOptional);
+    ~ProgramPruner();
+
+    // Prunes `blocks` in place; the report covers these blocks only.
+    PruneReport prune(std::vector<VaultBlock> &blocks);
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
@@ -0,0 +1,802 @@
+#include "archive.h"
+
+#include "config.h"
+#include "crypto.h"
+#include "merkle.h"
+#include "shard.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// The index of a `segment <n>` line; false when the line is malformed, as a torn append leaves it.
+bool parse_segment_index(const std::string &line, int &index) {
+    const char *first = line.data() + 8;
+    const char *last = line.data() + line.size();
+    auto parsed = std::from_chars(first, last, index);
+    return parsed.ec == std::errc() && parsed.ptr == last && first != last && index > 0;
+}
+
+// Bytes up to the end of the last complete MAC line: the base `hmac` trailer or a segment's
+// newline-terminated `segment-hmac`. Anything after it is a torn append, which readers drop.
+// The whole file when it has no base trailer.
+std::uint64_t authenticated_length(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + path);
+    std::string line;
+    std::uint64_t good = 0;
+    bool base = false;
+    bool inSegment = false;
+    while (std::getline(in, line)) {
+        if (in.eof()) break; // unterminated last line
+        if (line.rfind("index-end ", 0) == 0) { in.ignore(std::stoll(line.substr(10))); continue; }
+        if (!base) {
+            if (line.rfind("hmac ", 0) == 0) {
+                base = true;
+                good = static_cast<std::uint64_t>(in.tellg());
+            }
+            continue;
+        }
+        int index = 0;
+        if (line.rfind("segment ", 0) == 0) {
+            if (!parse_segment_index(line, index)) break;
+            inSegment = true;
+        } else if (line.rfind("segment-hmac ", 0) == 0 && inSegment) {
+            good = static_cast<std::uint64_t>(in.tellg());
+            inSegment = false;
+        }
+    }
+    return base ? good : std::filesystem::file_size(path);
+}
+
+// Unformatted file output through one large user-space buffer; commit() flushes and fsyncs
+// on the same descriptor so durability costs no extra open. New files are owner-only.
+class FileSink : public std::streambuf {
+  public:
+    FileSink(const std::string &path, bool append) : path_(path), buffer_(1 << 20) {
+#ifdef _WIN32
+        fd_ = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC), _S_IREAD | _S_IWRITE);
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0600);
+#endif
+        if (fd_ < 0) throw std::runtime_error("Unable to write: " + path);
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+    ~FileSink() override {
+        if (fd_ >= 0) {
+#ifdef _WIN32
+            _close(fd_);
+#else
+            ::close(fd_);
+#endif
+        }
+    }
+    FileSink(const FileSink &) = delete;
+    FileSink &operator=(const FileSink &) = delete;
+
+    void commit() {
+        if (!drain()) throw std::runtime_error("Write failed: " + path_);
+#ifdef _WIN32
+        int rc = _commit(fd_);
+#else
+        int rc = ::fsync(fd_);
+#endif
+        if (rc != 0) throw std::runtime_error("fsync failed: " + path_);
+    }
+
+  protected:
+    int_type overflow(int_type ch) override {
+        if (!drain()) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+    int sync() override { return drain() ? 0 : -1; }
+
+  private:
+    bool drain() {
+        const char *p = pbase();
+        while (p < pptr()) {
+#ifdef _WIN32
+            auto n = _write(fd_, p, static_cast<unsigned>(pptr() - p));
+#else
+            auto n = ::write(fd_, p, static_cast<std::size_t>(pptr() - p));
+#endif
+            if (n < 0 && errno == EINTR) continue; // interrupted before anything was written
+            if (n <= 0) return false;
+            p += n;
+        }
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return true;
+    }
+
+    std::string path_;
+    std::vector<char> buffer_;
+    int fd_{-1};
+};
+
+void sync_directory(const std::filesystem::path &dir) {
+#ifdef _WIN32
+    (void)dir; // MoveFileEx with MOVEFILE_WRITE_THROUGH already flushed the rename
+#else
+    int fd = ::open(dir.empty() ? "." : dir.string().c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Unable to open directory: " + dir.string());
+    int rc = ::fsync(fd);
+    ::close(fd);
+    if (rc != 0) throw std::runtime_error("fsync failed: " + dir.string());
+#endif
+}
+
+void replace_file(const std::string &from, const std::string &to) {
+#ifdef _WIN32
+    if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        throw std::runtime_error("Unable to replace: " + to);
+    }
+#else
+    if (std::rename(from.c_str(), to.c_str()) != 0) throw std::runtime_error("Unable to replace: " + to);
+#endif
+}
+
+// A staged file that replaces an archive keeps the archive's mode; the rename would
+// otherwise swap it for the owner-only mode FileSink creates with.
+void keep_mode(const std::string &temp, const std::string &dest) {
+    std::error_code ec;
+    auto st = std::filesystem::status(dest, ec);
+    if (ec || !std::filesystem::exists(st)) return;
+    std::filesystem::permissions(temp, st.permissions(), std::filesystem::perm_options::replace);
+}
+}
+
+std::vector<std::string> sorted_unique(std::vector<std::string> vals) {
+    std::sort(vals.begin(), vals.end());
+    vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
+    return vals;
+}
+
+bool is_cipher_ref(const std::string &cipher) {
+    return !cipher.empty() && cipher[0] == '@';
+}
+
+std::string resolve_cipher_ref(std::istream &in, std::uint64_t recordsBase, const std::string &ref) {
+    std::uint64_t offset = 0;
+    try {
+        offset = std::stoull(ref.substr(1));
+    } catch (const std::exception &) {
+        throw std::runtime_error("Malformed cipher reference: " + ref);
+    }
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(recordsBase + offset));
+    std::string line;
+    if (!std::getline(in, line) || line.rfind("    entry ", 0) != 0 || !std::getline(in, line) || line.rfind("      digest ", 0) != 0 ||
+        !std::getline(in, line) || line.rfind("      cipher ", 0) != 0 || is_cipher_ref(line.substr(13))) {
+        throw std::runtime_error("Cipher reference " + ref + " does not point at a stored cipher");
+    }
+    return line.substr(13);
+}
+
+RecordWriter::RecordWriter(std::ostream &out, std::vector<RecordLayout> *layout, crypto::Hmac *mac, bool dedupe)
+    : out_(out), layout_(layout), mac_(mac), dedupe_(dedupe) {}
+
+void RecordWriter::emit(const std::string &text, const std::string *macText) {
+    out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+    if (mac_) mac_->update(macText ? *macText : text);
+    pos_ += text.size();
+}
+
+void RecordWriter::begin_vault(const std::string &name, bool optional, bool sealed) {
+    if (layout_) {
+        for (auto &earlier : *layout_) {
+            if (earlier.vault == name) earlier.latest = false;
+        }
+        layout_->push_back({name, optional, sealed, true, {}});
+    }
+    emit("vault " + name + " (" + (optional ? "optional" : "required") + ")\n");
+    emit(std::string("sealed ") + (sealed ? "true" : "false") + "\n");
+}
+
+void RecordWriter::begin_registry(const std::string &name) {
+    end_registry();
+    inRegistry_ = true;
+    if (layout_) layout_->back().registries.push_back({name, {}, {}, {}});
+    emit("  registry " + name + "\n");
+}
+
+void RecordWriter::entry(const std::string &key, const std::string &digest, const std::string &cipher) {
+    if (layout_) {
+        auto &slot = layout_->back().registries.back();
+        slot.offsets.push_back(pos_);
+        keyHashes_.push_back(BloomFilter::hash(key));
+        append_page_entry(page_, key, digest, cipher);
+        if (slot.offsets.size() % kMerklePageEntries == 0) {
+            slot.pages.push_back(merkle_page_hash(page_));
+            page_.clear();
+        }
+    }
+    auto at = pos_;
+    emit("    entry " + key + "\n");
+    emit("      digest " + digest + "\n");
+    auto line = "      cipher " + cipher + "\n";
+    if (dedupe_) {
+        auto first = firstCipher_.emplace(cipher, at);
+        if (!first.second) {
+            emit("      cipher @" + std::to_string(first.first->second) + "\n", &line);
+            return;
+        }
+    }
+    emit(line);
+}
+
+void RecordWriter::end_registry() {
+    if (!inRegistry_) return;
+    inRegistry_ = false;
+    if (!layout_) return;
+    auto &slot = layout_->back().registries.back();
+    if (!page_.empty()) slot.pages.push_back(merkle_page_hash(page_));
+    page_.clear();
+    slot.filter = BloomFilter(keyHashes_.size());
+    for (auto h : keyHashes_) slot.filter.add_hash(h);
+    keyHashes_.clear();
+}
+
+void RecordWriter::end_vault() {
+    end_registry();
+    emit("---\n");
+}
+
+void write_vault_record(RecordWriter &writer, const SealedVault &v) {
+    writer.begin_vault(v.name, v.optional, v.sealed);
+    std::vector<std::string> registryNames;
+    registryNames.reserve(v.registries.size());
+    for (const auto &regPair : v.registries) registryNames.push_back(regPair.first);
+    std::sort(registryNames.begin(), registryNames.end());
+    for (const auto &regName : registryNames) {
+        const auto &reg = *v.registries.at(regName);
+        writer.begin_registry(regName);
+        std::vector<std::string> entryNames;
+        entryNames.reserve(reg.entries.size());
+        for (const auto &entry : reg.entries) entryNames.push_back(entry.first);
+        std::sort(entryNames.begin(), entryNames.end());
+        for (const auto &entryName : entryNames) {
+            const auto &entry = reg.entries.at(entryName);
+            writer.entry(entryName, entry.digest, entry.cipher);
+        }
+    }
+    writer.end_vault();
+}
+
+void write_vault_records(std::ostream &out, const std::vector<SealedVault> &vaults, std::vector<RecordLayout> *layout, bool dedupe) {
+    RecordWriter writer(out, layout, nullptr, dedupe);
+    for (const auto &v : vaults) write_vault_record(writer, v);
+}
+
+std::string write_svau_header(std::ostream &out, const std::vector<RecordLayout> &layout, const std::string &token,
+                       const std::string &masterKeyHex, const std::vector<std::string> &dependencies) {
+    out << "# Vault Secure Archive\n";
+    auto deps = sorted_unique(dependencies);
+    for (const auto &d : deps) out << "depends " << d << "\n";
+
+    std::vector<std::string> leaves{merkle_header_leaf(deps)};
+    std::vector<std::size_t> served{0}; // leaves the index checks, which get a stored path
+    std::string pagesLines;
+    std::string vaultLines;
+    for (const auto &record : layout) {
+        if (record.latest) {
+            vaultLines += "index-vault " + record.vault + " " + (record.optional ? "optional" : "required") + " " +
+                          (record.sealed ? "sealed" : "open") + " " + std::to_string(leaves.size()) + "\n";
+            served.push_back(leaves.size());
+        }
+        leaves.push_back(merkle_vault_leaf(record.vault, record.optional, record.sealed));
+        for (const auto &reg : record.registries) {
+            auto filterHex = record.latest ? reg.filter.to_hex() : std::string();
+            if (record.latest) {
+                pagesLines += "merkle-pages " + record.vault + " " + reg.name + " " + std::to_string(leaves.size()) + " ";
+                for (const auto &p : reg.pages) pagesLines += p;
+                pagesLines += "\n";
+                served.push_back(leaves.size());
+            }
+            leaves.push_back(merkle_registry_leaf(record.vault, reg.name, record.latest, reg.offsets.size(), reg.pages, filterHex));
+        }
+    }
+
+    out << vaultLines;
+    std::uint64_t tableOffset = 0;
+    for (const auto &record : layout) {
+        if (!record.latest) continue;
+        for (const auto &reg : record.registries) {
+            out << "index " << record.vault << " " << reg.name << " " << (record.sealed ? "sealed" : "open") << " " << reg.offsets.size() << " " << tableOffset << "\n";
+            tableOffset += reg.offsets.size() * kIndexRowBytes;
+        }
+    }
+    for (const auto &record : layout) {
+        if (!record.latest) continue;
+        for (const auto &reg : record.registries) {
+            out << "bloom " << record.vault << " " << reg.name << " " << reg.filter.keys() << " " << reg.filter.to_hex() << "\n";
+        }
+    }
+    auto count = leaves.size();
+    auto tree = merkle_tree(std::move(leaves));
+    auto rootMac = merkle_mac(tree.back().front(), count, token, masterKeyHex);
+    out << "merkle " << count << " " << rootMac << "\n";
+    for (auto leaf : served) {
+        out << "merkle-path " << leaf << " ";
+        for (const auto &h : merkle_path(tree, leaf)) out << h;
+        out << "\n";
+    }
+    out << pagesLines;
+    out << "index-end " << tableOffset << "\n";
+    char row[kIndexRowBytes + 1];
+    for (const auto &record : layout) {
+        if (!record.latest) continue;
+        for (const auto &reg : record.registries) {
+            for (auto offset : reg.offsets) {
+                std::snprintf(row, sizeof(row), "%016llx\n", static_cast<unsigned long long>(offset));
+                out.write(row, kIndexRowBytes);
+            }
+        }
+    }
+    return rootMac;
+}
+
+std::string write_svau(std::ostream &out, const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex,
+                const std::vector<std::string> &dependencies) {
+    // records are rendered first so the header can carry their offsets and hashes
+    std::ostringstream records;
+    std::vector<RecordLayout> layout;
+    write_vault_records(records, vaults, &layout, true);
+    auto rootMac = write_svau_header(out, layout, token, masterKeyHex, dependencies);
+    // hmac is written separately after computation
+    out << records.str();
+    return rootMac;
+}
+
+ArchiveBatch::~ArchiveBatch() {
+    std::error_code ec;
+    for (const auto &s : staged_) std::filesystem::remove(s.temp, ec);
+}
+
+std::string ArchiveBatch::stage(const std::string &outPath) {
+#ifdef _WIN32
+    auto pid = _getpid();
+#else
+    auto pid = ::getpid();
+#endif
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto temp = outPath + ".tmp-" + std::to_string(pid) + "-" + std::to_string(staged_.size());
+    staged_.push_back({temp, outPath});
+    return temp;
+}
+
+void ArchiveBatch::add(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                       const std::string &masterKeyHex, const std::vector<std::string> &dependencies, const std::string &hmac) {
+    add_with(outPath, [&](std::ostream &out) {
+        write_svau(out, vaults, token, masterKeyHex, dependencies);
+        out << "hmac " << hmac << "\n";
+    });
+}
+
+void ArchiveBatch::add_with(const std::string &outPath, const std::function<void(std::ostream &)> &write) {
+    auto temp = stage(outPath);
+    FileSink sink(temp, false);
+    keep_mode(temp, outPath);
+    std::ostream out(&sink);
+    write(out);
+    if (!out) throw std::runtime_error("Write failed: " + temp);
+    sink.commit();
+}
+
+void ArchiveBatch::add_file(const std::string &outPath, const std::string &sourcePath) {
+    auto temp = stage(outPath);
+    std::error_code ec;
+    std::filesystem::create_hard_link(sourcePath, temp, ec);
+    if (!ec) return;
+    std::ifstream in(sourcePath, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + sourcePath);
+    FileSink sink(temp, false);
+    keep_mode(temp, outPath);
+    std::ostream out(&sink);
+    out << in.rdbuf();
+    if (!out) throw std::runtime_error("Write failed: " + temp);
+    sink.commit();
+}
+
+void ArchiveBatch::commit() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::filesystem::path> dirs;
+    for (const auto &s : staged_) {
+        replace_file(s.temp, s.dest);
+        dirs.push_back(std::filesystem::path(s.dest).parent_path());
+    }
+    staged_.clear();
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    for (const auto &d : dirs) sync_directory(d);
+}
+
+void write_svau_file(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                     const std::string &masterKeyHex, const std::vector<std::string> &dependencies, const std::string &hmac) {
+    ArchiveBatch batch;
+    batch.add(outPath, vaults, token, masterKeyHex, dependencies, hmac);
+    batch.commit();
+}
+
+StreamedArchiveWriter::StreamedArchiveWriter(const std::string &outPath, const std::string &token, const std::string &masterKeyHex,
+                                             const std::vector<std::string> &dependencies)
+    : outPath_(outPath), token_(token), masterKeyHex_(masterKeyHex), dependencies_(sorted_unique(dependencies)),
+      sidePath_(outPath + ".records.tmp"), side_(sidePath_, std::ios::binary | std::ios::trunc),
+      mac_(std::make_unique<crypto::Hmac>(masterKeyHex)) {
+    if (!side_) throw std::runtime_error("Unable to write: " + sidePath_);
+    mac_->update(archive_mac_preamble(token_, dependencies_));
+    writer_ = std::make_unique<RecordWriter>(side_, &layout_, mac_.get());
+}
+
+StreamedArchiveWriter::~StreamedArchiveWriter() {
+    side_.close();
+    std::error_code ec;
+    std::filesystem::remove(sidePath_, ec);
+}
+
+std::uint64_t StreamedArchiveWriter::commit() {
+    side_.close();
+    if (!side_) throw std::runtime_error("Write failed: " + sidePath_);
+    auto bytes = static_cast<std::uint64_t>(std::filesystem::file_size(sidePath_));
+    auto hmac = mac_->final();
+    ArchiveBatch batch;
+    batch.add_with(outPath_, [&](std::ostream &out) {
+        write_svau_header(out, layout_, token_, masterKeyHex_, dependencies_);
+        std::ifstream records(sidePath_, std::ios::binary);
+        if (!records) throw std::runtime_error("Unable to read: " + sidePath_);
+        if (bytes) out << records.rdbuf();
+        out << "hmac " << hmac << "\n";
+    });
+    batch.commit();
+    return bytes;
+}
+
+std::string archive_mac_preamble(const std::string &token, const std::vector<std::string> &dependencies) {
+    std::string out = "token " + token + "\n";
+    for (const auto &d : sorted_unique(dependencies)) out += "depends " + d + "\n";
+    return out;
+}
+
+std::string compute_archive_hmac(const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex, const std::vector<std::string> &dependencies) {
+    // deterministic serialization (token is implicit secret; not written to archive)
+    std::ostringstream oss;
+    oss << archive_mac_preamble(token, dependencies);
+    write_vault_records(oss, vaults);
+    return crypto::digest(oss.str(), masterKeyHex);
+}
+
+std::string compute_segment_hmac(const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex, int index, const std::string &prevHmac) {
+    std::ostringstream oss;
+    oss << "token " << token << "\n";
+    oss << "segment " << index << "\n";
+    oss << "prev " << prevHmac << "\n";
+    write_vault_records(oss, vaults);
+    return crypto::digest(oss.str(), masterKeyHex);
+}
+
+LoadedArchive read_svau(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + path);
+    LoadedArchive result;
+    std::vector<SealedVault> vaults;
+    std::string line;
+    SealedVault current;
+    std::string currentReg;
+    std::string currentEntryKey;
+    std::vector<std::pair<std::pair<std::string, std::string>, BloomFilter>> filters;
+    std::optional<std::uint64_t> recordsBase;
+    std::ifstream refs; // second handle for resolving cipher references
+    // vault records after a "segment" line belong to that segment, not the base
+    auto *target = &vaults;
+    auto flush = [&]() {
+        if (!current.name.empty()) target->push_back(std::move(current));
+        current = SealedVault{};
+        currentReg.clear();
+    };
+
+    while (std::getline(in, line)) {
+        // past the base trailer, an unterminated last line is a torn append
+        if (in.eof() && !result.hmac.empty()) break;
+        if (line == "---") { flush(); continue; }
+        if (line.empty() || line == "# Vault Secure Archive") continue;
+        if (line.rfind("hmac ", 0) == 0) { result.hmac = line.substr(5); continue; }
+        if (line.rfind("segment ", 0) == 0) {
+            flush();
+            ArchiveSegment seg;
+            if (!parse_segment_index(line, seg.index)) {
+                std::cerr << "Warning: discarding malformed segment in " << path << "\n";
+                break;
+            }
+            result.segments.push_back(std::move(seg));
+            target = &result.segments.back().vaults;
+            continue;
+        }
+        if (line.rfind("segment-hmac ", 0) == 0) {
+            flush();
+            if (!result.segments.empty()) result.segments.back().hmac = line.substr(13);
+            continue;
+        }
+        if (line.rfind("depends ", 0) == 0) { result.dependencies.push_back(line.substr(8)); continue; }
+        if (line.rfind("index-end ", 0) == 0) { in.ignore(std::stoll(line.substr(10))); continue; }
+        if (line.rfind("index ", 0) == 0 || line.rfind("index-vault ", 0) == 0 || line.rfind("merkle", 0) == 0) continue;
+        if (line.rfind("bloom ", 0) == 0) {
+            std::istringstream iss(line.substr(6));
+            std::string vault, registry, bits;
+            std::size_t keys = 0;
+            if (iss >> vault >> registry >> keys >> bits) filters.push_back({{vault, registry}, BloomFilter::from_hex(keys, bits)});
+            continue;
+        }
+        if (line.rfind("token ", 0) == 0) { result.token = line.substr(6); continue; }
+        if (line.rfind("vault ", 0) == 0) {
+            flush();
+            if (!recordsBase) recordsBase = static_cast<std::uint64_t>(in.tellg()) - line.size() - 1;
+            std::istringstream iss(line.substr(6));
+            std::string name, paren;
+            iss >> name;
+            current.name = name;
+            auto pos = line.find('(');
+            current.optional = (pos != std::string::npos && line.find("optional") != std::string::npos);
+        } else if (line.rfind("sealed ", 0) == 0) {
+            current.sealed = (line.find("true") != std::string::npos);
+        } else if (line.rfind("  registry ", 0) == 0) {
+            currentReg = line.substr(11);
+            current.registries[currentReg] = Cow<SealedRegistry>();
+        } else if (line.rfind("    entry ", 0) == 0) {
+            currentEntryKey = line.substr(10);
+            current.registries[currentReg].write().entries[currentEntryKey] = SealedEntry{};
+        } else if (line.rfind("      digest ", 0) == 0) {
+            auto &entry = current.registries[currentReg].write().entries[currentEntryKey];
+            entry.digest = line.substr(13);
+        } else if (line.rfind("      cipher ", 0) == 0) {
+            auto &entry = current.registries[currentReg].write().entries[currentEntryKey];
+            entry.cipher = line.substr(13);
+            if (is_cipher_ref(entry.cipher)) {
+                if (!refs.is_open()) refs.open(path, std::ios::binary);
+                entry.cipher = resolve_cipher_ref(refs, recordsBase.value_or(0), entry.cipher);
+            }
+        }
+    }
+    flush();
+    // A segment without its trailing MAC is a torn append; drop it so readers see the last complete view.
+    if (!result.segments.empty() && result.segments.back().hmac.empty()) {
+        std::cerr << "Warning: discarding incomplete segment " << result.segments.back().index << " in " << path << "\n";
+        result.segments.pop_back();
+    }
+    // filters describe the last base record of each vault; segments are folded in later
+    for (auto &f : filters) {
+        auto it = std::find_if(vaults.rbegin(), vaults.rend(), [&](const SealedVault &v) { return v.name == f.first.first; });
+        if (it == vaults.rend()) continue;
+        auto reg = it->registries.find(f.first.second);
+        if (reg == it->registries.end() || reg->second->entries.size() != f.second.keys()) continue;
+        reg->second.write().filter = std::make_shared<const BloomFilter>(std::move(f.second));
+    }
+    result.vaults = std::move(vaults);
+    return result;
+}
+
+LoadedArchive open_archive(const std::string &path, const VaultConfig &cfg) {
+    if (is_shard_manifest(path)) return open_sharded(path, cfg);
+    auto archive = read_svau(path);
+    // token is not stored for new archives; accept only if present and matching
+    if (!archive.token.empty() && archive.token != cfg.token) {
+        throw std::runtime_error("Token mismatch for archive: " + path);
+    }
+    // inject master key (not stored in archive) and verify hmac using current token
+    for (auto &v : archive.vaults) v.masterKeyHex = cfg.masterKey;
+    auto want = compute_archive_hmac(archive.vaults, cfg.token, cfg.masterKey, archive.dependencies);
+    if (!archive.hmac.empty() && archive.hmac != want) {
+        throw std::runtime_error("Archive HMAC verification failed: " + path);
+    }
+    // filters sit outside the MAC; one that would report a stored key missing is discarded
+    for (auto &v : archive.vaults) {
+        for (auto &regPair : v.registries) {
+            const auto &reg = *regPair.second;
+            if (!reg.filter) continue;
+            bool sound = std::all_of(reg.entries.begin(), reg.entries.end(), [&](const std::pair<const std::string, SealedEntry> &e) {
+                return reg.filter->may_contain(e.first);
+            });
+            if (!sound) regPair.second.write().filter.reset();
+        }
+    }
+    apply_segments(archive, cfg.token, cfg.masterKey);
+    return archive;
+}
+
+std::vector<std::string> read_dependencies(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Unable to read: " + path);
+    std::vector<std::string> deps;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.rfind("depends ", 0) == 0) { deps.push_back(line.substr(8)); continue; }
+        if (line.rfind("index", 0) == 0 || line.rfind("vault ", 0) == 0 || line.rfind("hmac ", 0) == 0 || line.rfind("segment ", 0) == 0) break;
+    }
+    return deps;
+}
+
+namespace {
+// The file's last line without its line break; reads only the tail.
+std::string last_line(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + path);
+    in.seekg(0, std::ios::end);
+    auto size = static_cast<std::uint64_t>(in.tellg());
+    auto tail = std::min<std::uint64_t>(size, 512);
+    std::string buf(static_cast<std::size_t>(tail), '\0');
+    in.seekg(static_cast<std::streamoff>(size - tail));
+    in.read(&buf[0], static_cast<std::streamsize>(tail));
+    while (!buf.empty() && (buf.back() == '\n' || buf.back() == '\r')) buf.pop_back();
+    auto nl = buf.rfind('\n');
+    return nl == std::string::npos ? buf : buf.substr(nl + 1);
+}
+}
+
+bool archive_has_segments(const std::string &path) {
+    return last_line(path).rfind("hmac ", 0) != 0;
+}
+
+std::string read_chain_tail(const std::string &path) {
+    auto last = last_line(path);
+    if (last.rfind("hmac ", 0) == 0) return last.substr(5);
+    if (last.rfind("segment-hmac ", 0) == 0) return last.substr(13);
+    return {};
+}
+
+std::string chain_tail(const LoadedArchive &archive) {
+    return archive.segments.empty() ? archive.hmac : archive.segments.back().hmac;
+}
+
+std::string content_hmac(const LoadedArchive &archive, const std::string &token, const std::string &masterKeyHex) {
+    auto tail = chain_tail(archive);
+    if (!tail.empty()) return tail;
+    return compute_archive_hmac(archive.vaults, token, masterKeyHex, archive.dependencies);
+}
+
+// Verify each segment against the MAC chain, then fold its records into the base view.
+void fold_segment(std::vector<SealedVault> &vaults, const std::vector<SealedVault> &delta) {
+    for (const auto &d : delta) {
+        auto it = std::find_if(vaults.begin(), vaults.end(), [&](const SealedVault &v) { return v.name == d.name; });
+        if (it == vaults.end()) {
+            vaults.push_back(d);
+            continue;
+        }
+        it->optional = d.optional;
+        it->sealed = d.sealed;
+        for (const auto &regPair : d.registries) {
+            auto &reg = it->registries[regPair.first].write();
+            for (const auto &entryPair : regPair.second->entries) reg.entries[entryPair.first] = entryPair.second;
+        }
+    }
+}
+
+void apply_segments(LoadedArchive &archive, const std::string &token, const std::string &masterKeyHex) {
+    std::string prev = archive.hmac;
+    int expected = 1;
+    for (auto &seg : archive.segments) {
+        if (seg.index != expected) {
+            throw std::runtime_error("Archive segment out of order: " + std::to_string(seg.index));
+        }
+        for (auto &v : seg.vaults) v.masterKeyHex = masterKeyHex;
+        auto want = compute_segment_hmac(seg.vaults, token, masterKeyHex, seg.index, prev);
+        if (seg.hmac != want) {
+            throw std::runtime_error("Archive segment " + std::to_string(seg.index) + " HMAC verification failed");
+        }
+        fold_segment(archive.vaults, seg.vaults);
+        prev = seg.hmac;
+        expected++;
+    }
+}
+
+// Records of `next` that differ from the replayed `base` view; repeated vault names fold in order.
+std::vector<SealedVault> diff_vaults(const std::vector<SealedVault> &base, const std::vector<SealedVault> &next) {
+    std::unordered_map<std::string, SealedVault> view;
+    for (const auto &v : base) view[v.name] = v;
+    std::vector<SealedVault> out;
+    for (const auto &v : next) {
+        auto found = view.find(v.name);
+        bool fresh = found == view.end();
+        SealedVault delta;
+        delta.name = v.name;
+        delta.optional = v.optional;
+        delta.sealed = v.sealed;
+        delta.masterKeyHex = v.masterKeyHex;
+        bool changed = fresh || found->second.optional != v.optional || found->second.sealed != v.sealed;
+        for (const auto &regPair : v.registries) {
+            const SealedRegistry *old = nullptr;
+            if (!fresh) {
+                auto regIt = found->second.registries.find(regPair.first);
+                if (regIt != found->second.registries.end()) old = &*regIt->second;
+            }
+            for (const auto &entryPair : regPair.second->entries) {
+                if (old) {
+                    auto entryIt = old->entries.find(entryPair.first);
+                    if (entryIt != old->entries.end() && entryIt->second.digest == entryPair.second.digest) continue;
+                }
+                delta.registries[regPair.first].write().entries[entryPair.first] = entryPair.second;
+                changed = true;
+            }
+        }
+        if (!changed) continue;
+        // merge into the running view so a later block with the same name diffs against it
+        auto &tracked = view[v.name];
+        tracked.name = v.name;
+        tracked.optional = v.optional;
+        tracked.sealed = v.sealed;
+        for (const auto &regPair : delta.registries) {
+            auto &reg = tracked.registries[regPair.first].write();
+            for (const auto &entryPair : regPair.second->entries) reg.entries[entryPair.first] = entryPair.second;
+        }
+        out.push_back(std::move(delta));
+    }
+    return out;
+}
+
+bool segment_expresses(const std::vector<SealedVault> &view, const std::vector<SealedVault> &next) {
+    std::unordered_map<std::string, const SealedVault *> byName;
+    for (const auto &v : next) {
+        if (!byName.emplace(v.name, &v).second) return false;
+    }
+    std::unordered_map<std::string, bool> seen;
+    for (const auto &v : view) {
+        if (!seen.emplace(v.name, true).second) return false;
+        auto found = byName.find(v.name);
+        if (found == byName.end()) return false;
+        for (const auto &regPair : v.registries) {
+            auto reg = found->second->registries.find(regPair.first);
+            if (reg == found->second->registries.end()) return false;
+            for (const auto &entryPair : regPair.second->entries) {
+                if (!reg->second->entries.count(entryPair.first)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void append_segment(const std::string &path, const std::vector<SealedVault> &delta, int index, const std::string &hmac) {
+    // a hard-linked archive (e.g. served from the build cache) gets its own copy before growing
+    if (std::filesystem::hard_link_count(path) > 1) {
+        auto temp = path + ".unlink";
+        std::filesystem::copy_file(path, temp, std::filesystem::copy_options::overwrite_existing);
+        replace_file(temp, path);
+    }
+    // cut a torn append off first, so the new segment follows the last complete MAC line
+    auto keep = authenticated_length(path);
+    if (keep < std::filesystem::file_size(path)) std::filesystem::resize_file(path, keep);
+    FileSink sink(path, true);
+    std::ostream out(&sink);
+    out << "segment " << index << "\n";
+    write_vault_records(out, delta);
+    out << "segment-hmac " << hmac << "\n";
+    if (!out) throw std::runtime_error("Unable to append: " + path);
+    sink.commit();
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "interpreter.h"
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct VaultConfig;
+
+namespace crypto {
+class Hmac;
+}
+
+// An appended delta: vault records holding only changed entries, chained to the
+// previous segment (or the base hmac) by its own MAC.
+struct ArchiveSegment {
+    int index{};
+    std::string hmac;
+    std::vector<SealedVault> vaults;
+};
+
+struct LoadedArchive {
+    std::string token;
+    std::string hmac;
+    std::vector<std::string> dependencies;
+    std::vector<SealedVault> vaults;
+    std::vector<ArchiveSegment> segments;
+};
+
+// Where write_vault_records put one registry: byte offsets of its `entry` lines, in key
+// order, relative to the first vault record, a Bloom filter over its keys and its Merkle page
+// hashes. For the latest record of each vault these become the header's `index`, `bloom` and
+// `merkle-pages` lines plus a table of fixed-width offsets; see archive_index.h and merkle.h.
+struct RegistryLayout {
+    std::string name;
+    std::vector<std::uint64_t> offsets;
+    BloomFilter filter;
+    std::vector<std::string> pages;
+};
+
+// For the latest record of each vault name this becomes an `index-vault` line naming its flags
+// and Merkle leaf.
+struct RecordLayout {
+    std::string vault;
+    bool optional{};
+    bool sealed{};
+    bool latest{}; // last record of this vault name; earlier ones are superseded snapshots
+    std::vector<RegistryLayout> registries;
+};
+
+// One table row: 16 hex digits and a newline.
+constexpr std::size_t kIndexRowBytes = 17;
+
+std::vector<std::string> sorted_unique(std::vector<std::string> vals);
+
+// A `cipher` line may hold `@<offset>` instead of the value: the cipher of the entry whose
+// `entry` line sits at that offset from the first vault record. Base records written with
+// `dedupe` store each distinct cipher once this way (deterministic sealing repeats them across
+// vaults and snapshots). MACs, Merkle pages and readers all see the resolved value.
+bool is_cipher_ref(const std::string &cipher);
+// The cipher a reference points at; `in` is the archive opened in binary mode, recordsBase the
+// offset of its first vault record. Leaves `in` positioned after the target entry.
+std::string resolve_cipher_ref(std::istream &in, std::uint64_t recordsBase, const std::string &ref);
+
+// Writes vault records piece by piece, for producers that stream them, and optionally collects
+// their layout and feeds every byte to a MAC. Registries and entries must arrive in sorted
+// order, as write_vault_records emits them. With `dedupe`, repeated ciphers become references;
+// the writer then keeps views of the ciphers it was given, which must outlive it.
+class RecordWriter {
+  public:
+    explicit RecordWriter(std::ostream &out, std::vector<RecordLayout> *layout = nullptr, crypto::Hmac *mac = nullptr,
+                          bool dedupe = false);
+
+    void begin_vault(const std::string &name, bool optional, bool sealed);
+    void begin_registry(const std::string &name);
+    void entry(const std::string &key, const std::string &digest, const std::string &cipher);
+    void end_vault();
+
+  private:
+    // `macText`, when given, is what the MAC sees in place of `text`.
+    void emit(const std::string &text, const std::string *macText = nullptr);
+    void end_registry();
+
+    std::ostream &out_;
+    std::vector<RecordLayout> *layout_;
+    crypto::Hmac *mac_;
+    bool dedupe_;
+    std::unordered_map<std::string_view, std::uint64_t> firstCipher_; // cipher -> offset of its first entry
+    std::uint64_t pos_{};
+    bool inRegistry_{false};
+    std::vector<std::uint64_t> keyHashes_;
+    std::string page_;
+};
+
+// One vault record, registries and entries in sorted order, as write_vault_records renders it.
+void write_vault_record(RecordWriter &writer, const SealedVault &vault);
+// With `layout`, also records where each registry landed; with `dedupe`, repeated ciphers are
+// written as references (see is_cipher_ref).
+void write_vault_records(std::ostream &out, const std::vector<SealedVault> &vaults, std::vector<RecordLayout> *layout = nullptr,
+                         bool dedupe = false);
+// Everything write_svau puts before the records: depends, index, bloom and Merkle lines and the
+// offset table, for records already written with the given layout. Returns the Merkle root MAC
+// it wrote.
+std::string write_svau_header(std::ostream &out, const std::vector<RecordLayout> &layout, const std::string &token,
+                       const std::string &masterKeyHex, const std::vector<std::string> &dependencies);
+// What compute_archive_hmac MACs ahead of the records: the token and sorted `depends` lines.
+std::string archive_mac_preamble(const std::string &token, const std::vector<std::string> &dependencies);
+// The archive without its `hmac` trailer. masterKeyHex keys the Merkle root MAC in the header,
+// which is returned.
+std::string write_svau(std::ostream &out, const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex,
+                const std::vector<std::string> &dependencies);
+std::string compute_archive_hmac(const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex, const std::vector<std::string> &dependencies);
+std::string compute_segment_hmac(const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex, int index, const std::string &prevHmac);
+
+LoadedArchive read_svau(const std::string &path);
+// Only the `depends` lines; stops at the first vault record instead of reading the whole archive.
+std::vector<std::string> read_dependencies(const std::string &path);
+// read_svau plus token check, hmac verification and segment replay under cfg's keys. A shard
+// manifest (shard.h) is opened as the merged view of its shards.
+LoadedArchive open_archive(const std::string &path, const VaultConfig &cfg);
+
+// True unless the file ends with the base `hmac` trailer: it has appended segments (possibly a
+// torn one), or is not an archive. Reads only the tail.
+bool archive_has_segments(const std::string &path);
+// The MAC that ends the file's chain, the base `hmac` or the last `segment-hmac`, read from the
+// tail without verifying anything; empty when the file ends otherwise.
+std::string read_chain_tail(const std::string &path);
+std::string chain_tail(const LoadedArchive &archive);
+// MAC identifying an opened archive's replayed contents; computed for unauthenticated legacy archives.
+std::string content_hmac(const LoadedArchive &archive, const std::string &token, const std::string &masterKeyHex);
+// Replays one segment's records into an archive view, as readers do.
+void fold_segment(std::vector<SealedVault> &vaults, const std::vector<SealedVault> &delta);
+void apply_segments(LoadedArchive &archive, const std::string &token, const std::string &masterKeyHex);
+std::vector<SealedVault> diff_vaults(const std::vector<SealedVault> &base, const std::vector<SealedVault> &next);
+// Whether appending diff_vaults(view, next) as a segment turns `view` into `next`. A segment
+// cannot drop a vault, registry or key, and both sides must name each vault once.
+bool segment_expresses(const std::vector<SealedVault> &view, const std::vector<SealedVault> &next);
+// Appends `delta` as segment `index`, after truncating any torn segment a previous append left.
+void append_segment(const std::string &path, const std::vector<SealedVault> &delta, int index, const std::string &hmac);
+
+// Builds a base archive from records produced one at a time (rekey, merge): they go through
+// records() into a side file next to outPath while their layout and the archive MAC are
+// collected, and commit() stages the header, a copy of the records and the trailer through an
+// ArchiveBatch. Memory holds the layout, not the records.
+class StreamedArchiveWriter {
+  public:
+    StreamedArchiveWriter(const std::string &outPath, const std::string &token, const std::string &masterKeyHex,
+                          const std::vector<std::string> &dependencies);
+    StreamedArchiveWriter(const StreamedArchiveWriter &) = delete;
+    StreamedArchiveWriter &operator=(const StreamedArchiveWriter &) = delete;
+    ~StreamedArchiveWriter();
+
+    RecordWriter &records() { return *writer_; }
+    // Returns the size of the records section.
+    std::uint64_t commit();
+
+  private:
+    std::string outPath_;
+    std::string token_;
+    WipedString masterKeyHex_;
+    std::vector<std::string> dependencies_;
+    std::string sidePath_;
+    std::ofstream side_;
+    std::vector<RecordLayout> layout_;
+    std::unique_ptr<crypto::Hmac> mac_;
+    std::unique_ptr<RecordWriter> writer_;
+};
+
+// Archives staged as fsynced temp files next to their destination. commit() renames them all
+// into place and then fsyncs each destination directory once, so a crash leaves either the old
+// archive or the complete new one, never a torn or unauthenticated file. add() may be called
+// from several threads.
+class ArchiveBatch {
+  public:
+    ArchiveBatch() = default;
+    ArchiveBatch(const ArchiveBatch &) = delete;
+    ArchiveBatch &operator=(const ArchiveBatch &) = delete;
+    ~ArchiveBatch();
+
+    void add(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+             const std::string &masterKeyHex, const std::vector<std::string> &dependencies, const std::string &hmac);
+    // Stages whatever `write` produces; an exception from it leaves nothing behind.
+    void add_with(const std::string &outPath, const std::function<void(std::ostream &)> &write);
+    // Stages an already-built archive (e.g. a cache entry), hard-linked when possible.
+    void add_file(const std::string &outPath, const std::string &sourcePath);
+    void commit();
+
+  private:
+    std::string stage(const std::string &outPath);
+
+    struct Staged {
+        std::string temp;
+        std::string dest;
+    };
+    std::mutex mutex_;
+    std::vector<Staged> staged_;
+};
+
+void write_svau_file(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                     const std::string &masterKeyHex, const std::vector<std::string> &dependencies, const std::string &hmac);
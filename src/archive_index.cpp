@@ -0,0 +1,252 @@
+#include "archive_index.h"
+
+#include "archive.h"
+#include "merkle.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+KeyRange KeyRange::prefix(const std::string &prefix) {
+    KeyRange r{prefix, std::nullopt};
+    // the successor of a prefix: drop trailing 0xff bytes and increment the last one left
+    std::string next = prefix;
+    while (!next.empty() && static_cast<unsigned char>(next.back()) == 0xff) next.pop_back();
+    if (!next.empty()) {
+        next.back() = static_cast<char>(static_cast<unsigned char>(next.back()) + 1);
+        r.to = next;
+    }
+    return r;
+}
+
+ArchiveIndex::ArchiveIndex(const std::string &path, const std::string &token, const std::string &masterKeyHex)
+    : path_(path), token_(token), masterKeyHex_(masterKeyHex), in_(path, std::ios::binary) {
+    if (!in_) throw std::runtime_error("Unable to read: " + path);
+    std::string line;
+    bool indexed = false;
+    while (std::getline(in_, line)) {
+        if (line.rfind("depends ", 0) == 0) {
+            dependencies_.push_back(line.substr(8));
+            continue;
+        }
+        if (line.rfind("merkle ", 0) == 0) {
+            // `merkle <leaf count> <root mac>`; older headers carried the MAC alone and are not served
+            std::istringstream iss(line.substr(7));
+            if (!(iss >> leafCount_ >> merkleMac_)) merkleMac_.clear();
+            continue;
+        }
+        if (line.rfind("merkle-path ", 0) == 0) {
+            std::istringstream iss(line.substr(12));
+            std::size_t leaf = 0;
+            std::string hex;
+            iss >> leaf;
+            iss >> hex; // empty for a tree of one leaf
+            paths_[leaf] = hex;
+            continue;
+        }
+        if (line.rfind("merkle-pages ", 0) == 0) {
+            std::istringstream iss(line.substr(13));
+            std::string vault, registry, hex;
+            std::size_t leaf = 0;
+            iss >> vault >> registry >> leaf;
+            iss >> hex; // empty for a registry without entries
+            auto found = tables_.find({vault, registry});
+            if (found == tables_.end()) continue;
+            found->second.leaf = leaf;
+            for (std::size_t i = 0; i + 64 <= hex.size(); i += 64) found->second.pages.push_back(hex.substr(i, 64));
+            continue;
+        }
+        if (line.rfind("index-end ", 0) == 0) {
+            tableBase_ = static_cast<std::uint64_t>(in_.tellg());
+            recordsBase_ = tableBase_ + std::stoull(line.substr(10));
+            indexed = true;
+            break;
+        }
+        if (line.rfind("index ", 0) == 0) {
+            std::istringstream iss(line.substr(6));
+            std::string vault, registry, state;
+            Table t;
+            iss >> vault >> registry >> state >> t.count >> t.offset;
+            if (!iss) throw std::runtime_error("Malformed index line in " + path + ": " + line);
+            t.sealed = state == "sealed";
+            tables_[{vault, registry}] = t;
+            continue;
+        }
+        if (line.rfind("index-vault ", 0) == 0) {
+            std::istringstream iss(line.substr(12));
+            Vault v;
+            std::string optional, state;
+            std::size_t leaf = 0;
+            iss >> v.name >> optional >> state >> leaf;
+            if (!iss) throw std::runtime_error("Malformed index line in " + path + ": " + line);
+            v.optional = optional == "optional";
+            v.sealed = state == "sealed";
+            vaults_[v.name] = {v, leaf};
+            continue;
+        }
+        if (line.rfind("bloom ", 0) == 0) {
+            std::istringstream iss(line.substr(6));
+            std::string vault, registry, bits;
+            std::size_t keys = 0;
+            iss >> vault >> registry >> keys >> bits;
+            auto found = tables_.find({vault, registry});
+            if (iss && found != tables_.end() && keys == found->second.count) {
+                found->second.filter = BloomFilter::from_hex(keys, bits);
+                found->second.filterHex = bits;
+            }
+            continue;
+        }
+        if (line.rfind("vault ", 0) == 0 || line.rfind("hmac ", 0) == 0 || line.rfind("segment ", 0) == 0) break;
+    }
+    if (!indexed || merkleMac_.empty()) return;
+
+    // appended segments (complete or torn) follow the base trailer and are not indexed
+    usable_ = !archive_has_segments(path);
+}
+
+std::vector<ArchiveIndex::Registry> ArchiveIndex::registries() const {
+    std::vector<Registry> out;
+    out.reserve(tables_.size());
+    for (const auto &t : tables_) out.push_back({t.first.first, t.first.second, t.second.sealed, t.second.count});
+    return out;
+}
+
+std::uint64_t ArchiveIndex::entry_offset(const Table &t, std::uint64_t i) {
+    char row[kIndexRowBytes];
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(tableBase_ + t.offset + i * kIndexRowBytes));
+    if (!in_.read(row, kIndexRowBytes)) throw std::runtime_error("Truncated index in " + path_);
+    return std::stoull(std::string(row, kIndexRowBytes - 1), nullptr, 16);
+}
+
+std::string ArchiveIndex::key_at(const Table &t, std::uint64_t i) {
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(recordsBase_ + entry_offset(t, i)));
+    std::string line;
+    if (!std::getline(in_, line) || line.rfind("    entry ", 0) != 0) {
+        throw std::runtime_error("Index does not match records in " + path_);
+    }
+    return line.substr(10);
+}
+
+std::uint64_t ArchiveIndex::bound(const Table &t, const std::string &key, bool strict) {
+    std::uint64_t lo = 0, hi = t.count;
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        auto k = key_at(t, mid);
+        if (strict ? k <= key : k < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool ArchiveIndex::verify_leaf(std::size_t index, const std::string &leaf) const {
+    auto found = paths_.find(index);
+    if (found == paths_.end() || found->second.size() % 64) return false;
+    std::vector<std::string> path;
+    for (std::size_t i = 0; i < found->second.size(); i += 64) path.push_back(found->second.substr(i, 64));
+    auto root = merkle_root_from_path(leaf, index, leafCount_, path);
+    return !root.empty() && merkle_mac(root, leafCount_, token_, masterKeyHex_) == merkleMac_;
+}
+
+void ArchiveIndex::check_root() {
+    if (rootChecked_) return;
+    if (!verify_leaf(0, merkle_header_leaf(sorted_unique(dependencies_)))) {
+        throw std::runtime_error("Archive Merkle root verification failed: " + path_);
+    }
+    rootChecked_ = true;
+}
+
+std::vector<ArchiveIndex::Vault> ArchiveIndex::vaults() {
+    std::vector<Vault> out;
+    if (!usable_) return out;
+    check_root();
+    for (const auto &entry : vaults_) {
+        const auto &v = entry.second.first;
+        if (!verify_leaf(entry.second.second, merkle_vault_leaf(v.name, v.optional, v.sealed))) {
+            throw std::runtime_error("Vault " + v.name + " failed Merkle verification in " + path_);
+        }
+        out.push_back(v);
+    }
+    return out;
+}
+
+void ArchiveIndex::authenticate(Table &t, const std::string &vault, const std::string &registry) {
+    if (t.authenticated) return;
+    check_root();
+    // the sealed flag decides whether readers decrypt; it must match the vault's leaf
+    auto owner = vaults_.find(vault);
+    if (owner == vaults_.end() || owner->second.first.sealed != t.sealed ||
+        !verify_leaf(owner->second.second, merkle_vault_leaf(vault, owner->second.first.optional, t.sealed))) {
+        throw std::runtime_error("Vault " + vault + " failed Merkle verification in " + path_);
+    }
+    auto expectPages = (t.count + kMerklePageEntries - 1) / kMerklePageEntries;
+    if (t.pages.size() != expectPages ||
+        !verify_leaf(t.leaf, merkle_registry_leaf(vault, registry, true, t.count, t.pages, t.filterHex))) {
+        throw std::runtime_error("Registry " + vault + "/" + registry + " failed Merkle verification in " + path_);
+    }
+    t.authenticated = true;
+}
+
+std::vector<IndexedEntry> ArchiveIndex::scan(const std::string &vault, const std::string &registry, const KeyRange &range,
+                                             const std::optional<std::string> &after, std::size_t limit) {
+    std::vector<IndexedEntry> out;
+    auto found = tables_.find({vault, registry});
+    if (!usable_ || found == tables_.end() || limit == 0) return out;
+    auto &t = found->second;
+    authenticate(t, vault, registry);
+    if (range.is_exact() && !t.filter.may_contain(range.from)) return out;
+    if (t.count == 0) return out;
+
+    // the search itself reads unauthenticated keys; what it lands on is checked below
+    bool strict = after && *after >= range.from;
+    const auto &lower = strict ? *after : range.from;
+    auto start = bound(t, lower, strict);
+    auto below = [&](const std::string &key) { return strict ? key <= lower : key < lower; };
+
+    // Read whole pages, from the one holding the entry just before `start` to the one holding
+    // the last entry examined, hashing each against its Merkle page hash. The entry before
+    // `start` must fall below the range and every entry returned within it, which together
+    // prove the search skipped nothing.
+    auto first = (start == 0 ? 0 : start - 1) / kMerklePageEntries * kMerklePageEntries;
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(recordsBase_ + entry_offset(t, first)));
+    std::string line;
+    std::string page;
+    bool done = false;
+    for (auto i = first; i < t.count; ++i) {
+        IndexedEntry e;
+        if (!std::getline(in_, line) || line.rfind("    entry ", 0) != 0) throw std::runtime_error("Index does not match records in " + path_);
+        e.key = line.substr(10);
+        if (!std::getline(in_, line) || line.rfind("      digest ", 0) != 0) throw std::runtime_error("Malformed entry in " + path_);
+        e.digest = line.substr(13);
+        if (!std::getline(in_, line) || line.rfind("      cipher ", 0) != 0) throw std::runtime_error("Malformed entry in " + path_);
+        e.cipher = line.substr(13);
+        if (is_cipher_ref(e.cipher)) {
+            auto resume = in_.tellg();
+            e.cipher = resolve_cipher_ref(in_, recordsBase_, e.cipher);
+            in_.clear();
+            in_.seekg(resume);
+        }
+        append_page_entry(page, e.key, e.digest, e.cipher);
+        if (i + 1 == start && !below(e.key)) throw std::runtime_error("Index does not match records in " + path_);
+        if (!done && i >= start) {
+            if (below(e.key)) throw std::runtime_error("Index does not match records in " + path_);
+            if (range.to && e.key >= *range.to) {
+                done = true;
+            } else {
+                out.push_back(std::move(e));
+                done = out.size() >= limit;
+            }
+        }
+        if ((i + 1) % kMerklePageEntries == 0 || i + 1 == t.count) {
+            if (merkle_page_hash(page) != t.pages[i / kMerklePageEntries]) {
+                throw std::runtime_error("Registry " + vault + "/" + registry + " page " + std::to_string(i / kMerklePageEntries) +
+                                         " failed Merkle verification in " + path_);
+            }
+            page.clear();
+            if (done) break;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "bloom.h"
+#include "secure_memory.h"
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Half-open key interval [from, to); `to` unset means unbounded. Keys compare bytewise, the
+// order write_svau sorts entries in.
+struct KeyRange {
+    std::string from;
+    std::optional<std::string> to;
+
+    static KeyRange all() { return {}; }
+    static KeyRange exact(const std::string &key) { return {key, key + std::string(1, '\0')}; }
+    static KeyRange prefix(const std::string &prefix);
+
+    bool contains(const std::string &key) const { return key >= from && (!to || key < *to); }
+    bool is_exact() const { return to && to->size() == from.size() + 1 && to->back() == '\0' && to->compare(0, from.size(), from) == 0; }
+};
+
+struct IndexedEntry {
+    std::string key;
+    std::string digest;
+    std::string cipher;
+};
+
+// Lookups through the sorted key index in an archive header: binary search over the offset
+// table, then a sequential read of just the matching entry records. Instead of the
+// whole-archive HMAC, results are authenticated through the Merkle tree (merkle.h): the first
+// lookup in a registry hashes the registry's leaf up its authentication path to the root MAC,
+// and every page an answer is drawn from (including the neighbours that prove a key absent)
+// is hashed and compared. Exact-key lookups consult the registry's Bloom filter,
+// which its leaf covers, first, so most absent keys cost no seek at all.
+class ArchiveIndex {
+  public:
+    // token and masterKeyHex are the archive's configuration; see VaultConfig.
+    ArchiveIndex(const std::string &path, const std::string &token, const std::string &masterKeyHex);
+
+    // False for archives written before the index or its Merkle tree existed and for archives
+    // with appended segments, which the index does not cover; read those with open_archive.
+    bool usable() const { return usable_; }
+
+    struct Registry {
+        std::string vault;
+        std::string registry;
+        bool sealed{};
+        std::uint64_t count{};
+    };
+    std::vector<Registry> registries() const;
+
+    struct Vault {
+        std::string name;
+        bool optional{};
+        bool sealed{};
+    };
+    // False for archives indexed before the header listed vaults (their flags and vaults
+    // without registries are then only in the records).
+    bool lists_vaults() const { return !vaults_.empty(); }
+    // The latest record of every vault name, sorted by name, checked against its Merkle leaf.
+    std::vector<Vault> vaults();
+    const std::vector<std::string> &dependencies() const { return dependencies_; }
+    // The header's Merkle root MAC, which identifies this exact archive (see shard.h).
+    const std::string &root_mac() const { return merkleMac_; }
+
+    // Entries of vault/registry in `range` in key order, starting after `after` when given;
+    // at most `limit` of them. Throws if any page read fails authentication.
+    std::vector<IndexedEntry> scan(const std::string &vault, const std::string &registry, const KeyRange &range,
+                                   const std::optional<std::string> &after, std::size_t limit);
+
+  private:
+    struct Table {
+        bool sealed{};
+        std::uint64_t count{};
+        std::uint64_t offset{};
+        BloomFilter filter;
+        std::string filterHex;
+        std::size_t leaf{};
+        std::vector<std::string> pages;
+        bool authenticated{false};
+    };
+
+    // Whether `leaf` at `index` hashes up its stored path to the MACed root.
+    bool verify_leaf(std::size_t index, const std::string &leaf) const;
+    void check_root();
+    void authenticate(Table &t, const std::string &vault, const std::string &registry);
+
+    std::uint64_t entry_offset(const Table &t, std::uint64_t i);
+    std::string key_at(const Table &t, std::uint64_t i);
+    // First position whose key is >= key (or > key when `strict`).
+    std::uint64_t bound(const Table &t, const std::string &key, bool strict);
+
+    std::string path_;
+    std::string token_;
+    WipedString masterKeyHex_;
+    std::ifstream in_;
+    std::vector<std::string> dependencies_;
+    std::string merkleMac_;
+    std::size_t leafCount_{};
+    std::map<std::size_t, std::string> paths_; // leaf -> concatenated sibling hashes
+    bool rootChecked_{false};
+    std::map<std::pair<std::string, std::string>, Table> tables_;
+    std::map<std::string, std::pair<Vault, std::size_t>> vaults_; // name -> flags, Merkle leaf
+    std::uint64_t tableBase_{};
+    std::uint64_t recordsBase_{};
+    bool usable_{false};
+};
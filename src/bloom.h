@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Blocked Bloom filter over registry keys: every key maps to one 512-bit block (a cache
+// line) and sets kProbes bits inside it, so a lookup touches a single line. Sized at about
+// ten bits per key, which keeps false positives near 1%; there are no false negatives.
+class BloomFilter {
+  public:
+    static constexpr std::size_t kBlockWords = 8;
+    static constexpr int kProbes = 7;
+
+    BloomFilter() = default;
+    explicit BloomFilter(std::size_t expectedKeys)
+        : words_(block_count(expectedKeys) * kBlockWords, 0) {}
+
+    void add(const std::string &key) { add_hash(hash(key)); }
+
+    // For callers that must size the filter after seeing the keys: collect hash(key) first.
+    void add_hash(std::uint64_t h) {
+        auto *block = &words_[block_of(h) * kBlockWords];
+        auto step = ((h >> 9) & 0x7fffff) | 1;
+        for (int i = 0; i < kProbes; ++i) {
+            auto bit = (h + static_cast<std::uint64_t>(i) * step) & 511;
+            block[bit >> 6] |= std::uint64_t{1} << (bit & 63);
+        }
+        keys_++;
+    }
+
+    bool may_contain(const std::string &key) const {
+        if (words_.empty()) return true;
+        auto h = hash(key);
+        const auto *block = &words_[block_of(h) * kBlockWords];
+        auto step = ((h >> 9) & 0x7fffff) | 1;
+        for (int i = 0; i < kProbes; ++i) {
+            auto bit = (h + static_cast<std::uint64_t>(i) * step) & 511;
+            if (!(block[bit >> 6] & (std::uint64_t{1} << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+    // FNV-1a plus a murmur-style finalizer; the high half picks the block, the low half the bits.
+    static std::uint64_t hash(const std::string &key) {
+        std::uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Number of keys added; a registry whose size differs has changed since the filter was built.
+    std::size_t keys() const { return keys_; }
+
+    std::string to_hex() const {
+        static const char hex[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(words_.size() * 16);
+        for (auto w : words_) {
+            for (int shift = 60; shift >= 0; shift -= 4) out.push_back(hex[(w >> shift) & 0xF]);
+        }
+        return out;
+    }
+
+    static BloomFilter from_hex(std::size_t keys, const std::string &text) {
+        if (text.empty() || text.size() % (kBlockWords * 16) != 0) throw std::runtime_error("Malformed bloom filter");
+        BloomFilter f;
+        f.keys_ = keys;
+        f.words_.resize(text.size() / 16);
+        for (std::size_t i = 0; i < f.words_.size(); ++i) f.words_[i] = std::stoull(text.substr(i * 16, 16), nullptr, 16);
+        return f;
+    }
+
+  private:
+    static std::size_t block_count(std::size_t keys) {
+        return keys * 10 / 512 + 1;
+    }
+
+    std::size_t block_of(std::uint64_t h) const {
+        return static_cast<std::size_t>((h >> 32) % (words_.size() / kBlockWords));
+    }
+
+    std::vector<std::uint64_t> words_;
+    std::size_t keys_{0};
+};
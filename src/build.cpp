@@ -0,0 +1,559 @@
+#include "build.h"
+
+#include "analysis.h"
+#include "archive.h"
+#include "cache.h"
+#include "config.h"
+#include "crypto.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parallel.h"
+#include "parser.h"
+#include "seed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+struct BuildJob {
+    std::string input;
+    std::string output;
+    std::vector<std::string> loadPaths;
+    std::string error;
+
+    // graph mode
+    std::vector<std::optional<std::size_t>> seedNodes; // per --load, the job whose output it is
+    std::vector<std::size_t> after;        // jobs named by `depends` lines of the existing output
+    std::vector<std::size_t> dependents;
+    std::size_t waiting{};
+    std::string key;
+    bool skipped{false};
+    std::shared_ptr<const LoadedArchive> result;
+
+    std::string cacheKey;
+    bool cacheHit{false};
+};
+
+struct BuildOptions {
+    std::vector<std::string> inputs;
+    std::optional<std::string> manifest;
+    std::optional<std::string> outDir;
+    std::vector<std::string> loadPaths;
+    SeedConflict loadConflict{SeedConflict::Error};
+    unsigned jobs{default_jobs()};
+    bool verbose{false};
+    bool materializeOptional{false};
+    bool deterministic{false};
+    bool graph{false};
+    bool cache{false};
+    bool pinBuiltins{false};
+    bool prune{true};
+    std::optional<std::string> cacheDir;
+};
+
+// An archive read from disk at most once, on first use, by whichever worker needs it.
+struct LazyArchive {
+    std::once_flag once;
+    std::shared_ptr<const LoadedArchive> archive;
+    std::string error;
+};
+
+void build_usage() {
+    std::cerr << "Usage: vaultc build <a.vau> [b.vau ...] [--manifest file] [--out-dir dir] [--load file.svau ...] [--load-conflict error|first|last] [--jobs n] [--graph] [--cache] [--cache-dir dir] [--pin-builtins] [--no-prune] [--verbose] [--materialize-optionals] [--deterministic]\n";
+    std::cerr << "Manifest lines: <input.vau> [--out file.svau] [--load file.svau ...]\n";
+}
+
+std::string normalized(const std::string &path) {
+    return std::filesystem::path(path).lexically_normal().string();
+}
+
+std::string output_for(const std::string &input, const BuildOptions &opts) {
+    auto name = std::filesystem::path(input).filename().replace_extension(".svau");
+    if (opts.outDir) return (std::filesystem::path(*opts.outDir) / name).string();
+    return std::filesystem::path(input).replace_extension(".svau").string();
+}
+
+std::vector<BuildJob> read_manifest(const std::string &path, const BuildOptions &opts) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Unable to read manifest: " + path);
+    std::vector<BuildJob> jobs;
+    std::string line;
+    int number = 0;
+    while (std::getline(in, line)) {
+        number++;
+        std::istringstream iss(line);
+        std::string word;
+        if (!(iss >> word) || word[0] == '#') continue;
+        BuildJob job;
+        job.input = word;
+        job.output = output_for(word, opts);
+        job.loadPaths = opts.loadPaths;
+        bool ownLoads = false; // a line's own --load flags replace the command-line seeds
+        while (iss >> word) {
+            std::string value;
+            if ((word == "--out" || word == "--load") && (iss >> value)) {
+                if (word == "--out") {
+                    job.output = value;
+                } else {
+                    if (!ownLoads) job.loadPaths.clear();
+                    ownLoads = true;
+                    job.loadPaths.push_back(value);
+                }
+            } else {
+                throw std::runtime_error("Bad manifest entry on line " + std::to_string(number) + ": " + line);
+            }
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+std::string read_bytes(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + path);
+    std::ostringstream oss;
+    oss << in.rdbuf();
+    return oss.str();
+}
+
+std::string stamp_path(const std::string &output) {
+    return output + ".stamp";
+}
+
+// `<input key>\n<output chain tail>\n`: the tail catches an output rewritten or appended to by
+// anything other than a graph build, which leaves the stamp as it was.
+struct Stamp {
+    std::string key;
+    std::string tail;
+};
+
+Stamp read_stamp(const std::string &output) {
+    std::ifstream in(stamp_path(output));
+    Stamp stamp;
+    if (in && std::getline(in, stamp.key)) std::getline(in, stamp.tail);
+    return stamp;
+}
+
+bool up_to_date(const std::string &output, const std::string &key) {
+    if (!std::filesystem::exists(output)) return false;
+    auto stamp = read_stamp(output);
+    return stamp.key == key && !stamp.tail.empty() && stamp.tail == read_chain_tail(output);
+}
+
+// Lex, parse, interpret and stage one script, or stage a cached archive for it. The returned
+// archive keeps its master key so graph dependents can seed from it without re-reading the file;
+// on a cache hit it is only loaded when needResult is set.
+std::shared_ptr<const LoadedArchive> compile_job(BuildJob &job, const std::vector<const LoadedArchive *> &seeds,
+                                                 const VaultConfig &cfg, const BuildOptions &opts, ArchiveBatch &batch,
+                                                 const BuildCache *cache, bool needResult) {
+    Parser parser(lex_file(job.input));
+    auto program = parser.parse();
+
+    // several seeds are merged per job: each job may combine a different set
+    LoadedArchive merged;
+    const LoadedArchive *seed = nullptr;
+    if (seeds.size() == 1) {
+        seed = seeds.front();
+    } else if (!seeds.empty()) {
+        merged = merge_seeds(seeds, job.loadPaths, opts.loadConflict, cfg.token, cfg.masterKey);
+        seed = &merged;
+    }
+    auto built = std::make_shared<LoadedArchive>();
+    if (seed) built->dependencies = seed_dependencies(*seed, job.loadPaths);
+    if (opts.prune) {
+        std::vector<std::string> seeded;
+        if (seed) for (const auto &v : seed->vaults) seeded.push_back(v.name);
+        prune_program(program, seeded, opts.materializeOptional);
+    }
+    if (cache && (opts.pinBuiltins || !uses_builtins(program))) {
+        std::vector<std::string> seedHmacs;
+        if (seed) seedHmacs.push_back(content_hmac(*seed, cfg.token, cfg.masterKey));
+        std::string flags = opts.materializeOptional ? "materialize-optionals" : "";
+        if (opts.deterministic) flags += " deterministic";
+        job.cacheKey = cache_key(job.input, seedHmacs, built->dependencies, cfg, flags);
+        if (auto hit = cache->lookup(job.cacheKey)) {
+            job.cacheHit = true;
+            batch.add_file(job.output, *hit);
+            if (!needResult) return nullptr;
+            return std::make_shared<const LoadedArchive>(open_archive(*hit, cfg));
+        }
+    }
+
+    InterpreterOptions interpOpts{};
+    interpOpts.materializeOptional = opts.materializeOptional;
+    interpOpts.deterministic = opts.deterministic;
+    interpOpts.forcedMasterKey = cfg.masterKey;
+    Interpreter interp(interpOpts);
+    if (seed) interp.seed(seed->vaults);
+    built->vaults = interp.run(program);
+    built->hmac = compute_archive_hmac(built->vaults, cfg.token, cfg.masterKey, built->dependencies);
+    batch.add(job.output, built->vaults, cfg.token, cfg.masterKey, built->dependencies, built->hmac);
+    return built;
+}
+
+std::size_t report_failures(const std::vector<BuildJob> &jobs) {
+    std::size_t failed = 0;
+    for (const auto &job : jobs) {
+        if (job.error.empty()) continue;
+        std::cerr << "Error: " << job.input << ": " << job.error << "\n";
+        failed++;
+    }
+    if (failed) std::cerr << failed << " of " << jobs.size() << " build(s) failed\n";
+    return failed;
+}
+
+int run_flat(std::vector<BuildJob> &jobs, const VaultConfig &cfg, const BuildOptions &opts, ArchiveBatch &batch,
+             const BuildCache *cache) {
+    // Each distinct seed archive is read and verified once and shared by every job using it.
+    std::vector<std::string> seedPaths;
+    for (const auto &job : jobs) {
+        seedPaths.insert(seedPaths.end(), job.loadPaths.begin(), job.loadPaths.end());
+    }
+    seedPaths = sorted_unique(std::move(seedPaths));
+    std::vector<std::shared_ptr<const LoadedArchive>> loaded(seedPaths.size());
+    std::vector<std::string> seedFailures(seedPaths.size());
+    parallel_for(seedPaths.size(), opts.jobs, [&](std::size_t i) {
+        try {
+            loaded[i] = std::make_shared<const LoadedArchive>(open_archive(seedPaths[i], cfg));
+        } catch (const std::exception &ex) {
+            seedFailures[i] = ex.what();
+        }
+    });
+    std::map<std::string, std::shared_ptr<const LoadedArchive>> seeds;
+    std::map<std::string, std::string> seedErrors;
+    for (std::size_t i = 0; i < seedPaths.size(); ++i) {
+        if (seedFailures[i].empty()) seeds[seedPaths[i]] = loaded[i]; else seedErrors[seedPaths[i]] = seedFailures[i];
+    }
+
+    parallel_for(jobs.size(), opts.jobs, [&](std::size_t i) {
+        auto &job = jobs[i];
+        try {
+            std::vector<const LoadedArchive *> jobSeeds;
+            for (const auto &path : job.loadPaths) {
+                auto failed = seedErrors.find(path);
+                if (failed != seedErrors.end()) throw std::runtime_error(failed->second);
+                jobSeeds.push_back(seeds.at(path).get());
+            }
+            compile_job(job, jobSeeds, cfg, opts, batch, cache, false);
+        } catch (const std::exception &ex) {
+            job.error = ex.what();
+        }
+    });
+    return report_failures(jobs) ? 1 : 0;
+}
+
+// Whether `to` is reachable from `from` along dependents edges.
+bool reaches(const std::vector<BuildJob> &jobs, std::size_t from, std::size_t to) {
+    std::vector<bool> seen(jobs.size(), false);
+    std::vector<std::size_t> stack{from};
+    while (!stack.empty()) {
+        auto i = stack.back();
+        stack.pop_back();
+        if (i == to) return true;
+        if (seen[i]) continue;
+        seen[i] = true;
+        for (auto d : jobs[i].dependents) stack.push_back(d);
+    }
+    return false;
+}
+
+// Wire --load relations and existing `depends` lines into edges between jobs. `depends` lines
+// describe the previous build, so they only order work: one that would close a cycle with this
+// build's edges (a --load relation reversed in the manifest) is dropped, not reported.
+void link_graph(std::vector<BuildJob> &jobs) {
+    std::map<std::string, std::size_t> byOutput;
+    std::map<std::string, std::vector<std::size_t>> byFilename;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        byOutput[normalized(jobs[i].output)] = i;
+        byFilename[std::filesystem::path(jobs[i].output).filename().string()].push_back(i);
+    }
+    std::vector<std::set<std::size_t>> producers(jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        auto &job = jobs[i];
+        for (const auto &path : job.loadPaths) {
+            auto it = byOutput.find(normalized(path));
+            job.seedNodes.push_back(it == byOutput.end() ? std::nullopt : std::optional<std::size_t>(it->second));
+            if (it != byOutput.end()) producers[i].insert(it->second);
+        }
+        for (auto p : producers[i]) jobs[p].dependents.push_back(i);
+    }
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        auto &job = jobs[i];
+        if (!std::filesystem::exists(job.output)) continue;
+        auto dir = std::filesystem::path(job.output).parent_path().lexically_normal();
+        std::set<std::size_t> picks;
+        for (const auto &dep : read_dependencies(job.output)) {
+            auto candidates = byFilename.find(dep);
+            if (candidates == byFilename.end()) continue;
+            // archives record bare filenames; prefer the producer living next to this output
+            auto pick = candidates->second.front();
+            for (auto c : candidates->second) {
+                if (std::filesystem::path(jobs[c].output).parent_path().lexically_normal() == dir) pick = c;
+            }
+            if (pick != i && !producers[i].count(pick)) picks.insert(pick);
+        }
+        for (auto pick : picks) {
+            if (reaches(jobs, i, pick)) continue;
+            job.after.push_back(pick);
+            jobs[pick].dependents.push_back(i);
+        }
+    }
+    for (std::size_t i = 0; i < jobs.size(); ++i) jobs[i].waiting = producers[i].size() + jobs[i].after.size();
+}
+
+void check_acyclic(const std::vector<BuildJob> &jobs) {
+    // 0 = unvisited, 1 = on the current path, 2 = done
+    std::vector<int> mark(jobs.size(), 0);
+    std::vector<std::size_t> path;
+    std::function<void(std::size_t)> visit = [&](std::size_t i) {
+        mark[i] = 1;
+        path.push_back(i);
+        for (auto d : jobs[i].dependents) {
+            if (mark[d] == 1) {
+                std::string cycle;
+                auto start = std::find(path.begin(), path.end(), d);
+                for (auto it = start; it != path.end(); ++it) cycle += jobs[*it].output + " -> ";
+                throw std::runtime_error("Dependency cycle: " + cycle + jobs[d].output);
+            }
+            if (mark[d] == 0) visit(d);
+        }
+        path.pop_back();
+        mark[i] = 2;
+    };
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (mark[i] == 0) visit(i);
+    }
+}
+
+int run_graph(std::vector<BuildJob> &jobs, const VaultConfig &cfg, const BuildOptions &opts, ArchiveBatch &batch,
+              const BuildCache *cache) {
+    link_graph(jobs);
+    check_acyclic(jobs);
+
+    // Archives that may be needed from disk: external seeds and outputs of up-to-date jobs.
+    std::map<std::string, LazyArchive> onDisk;
+    for (const auto &job : jobs) {
+        onDisk[normalized(job.output)];
+        for (const auto &path : job.loadPaths) onDisk[normalized(path)];
+    }
+    auto load = [&](const std::string &path) -> std::shared_ptr<const LoadedArchive> {
+        auto &lazy = onDisk.at(normalized(path));
+        std::call_once(lazy.once, [&]() {
+            try {
+                lazy.archive = std::make_shared<const LoadedArchive>(open_archive(path, cfg));
+            } catch (const std::exception &ex) {
+                lazy.error = ex.what();
+            }
+        });
+        if (!lazy.archive) throw std::runtime_error(lazy.error);
+        return lazy.archive;
+    };
+
+    auto process = [&](BuildJob &job) {
+        for (auto p : job.after) {
+            if (!jobs[p].error.empty()) throw std::runtime_error("dependency failed: " + jobs[p].output);
+        }
+        for (const auto &node : job.seedNodes) {
+            if (node && !jobs[*node].error.empty()) throw std::runtime_error("dependency failed: " + jobs[*node].output);
+        }
+        // Content key: script bytes, each seed's key (or file hash) and the config, MAC'd under
+        // the master key so a key change invalidates every stamp. `after` edges only order work;
+        // anything they could change reaches this job through its seeds' keys.
+        std::ostringstream material;
+        material << "vaultc-build 1\n";
+        material << "token " << cfg.token << "\n";
+        material << "script " << crypto::digest(read_bytes(job.input)) << "\n";
+        for (std::size_t s = 0; s < job.loadPaths.size(); ++s) {
+            const auto &node = job.seedNodes[s];
+            material << "seed " << (node ? jobs[*node].key : crypto::digest(read_bytes(job.loadPaths[s]))) << "\n";
+        }
+        if (job.loadPaths.size() > 1) material << "load-conflict " << static_cast<int>(opts.loadConflict) << "\n";
+        material << "optionals " << (opts.materializeOptional ? 1 : 0) << "\n";
+        if (opts.deterministic) material << "deterministic 1\n";
+        job.key = crypto::digest(material.str(), cfg.masterKey);
+
+        if (up_to_date(job.output, job.key)) {
+            job.skipped = true;
+            return;
+        }
+        std::vector<std::shared_ptr<const LoadedArchive>> held;
+        std::vector<const LoadedArchive *> seeds;
+        for (std::size_t s = 0; s < job.loadPaths.size(); ++s) {
+            const auto &node = job.seedNodes[s];
+            if (node) {
+                auto &producer = jobs[*node];
+                held.push_back(producer.skipped ? load(producer.output) : producer.result);
+            } else {
+                held.push_back(load(job.loadPaths[s]));
+            }
+            seeds.push_back(held.back().get());
+        }
+        job.result = compile_job(job, seeds, cfg, opts, batch, cache, !job.dependents.empty());
+    };
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::size_t> queue;
+    std::size_t remaining = jobs.size();
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].waiting == 0) queue.push_back(i);
+    }
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            ready.wait(lock, [&]() { return !queue.empty() || remaining == 0; });
+            if (remaining == 0) return;
+            auto i = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            try {
+                process(jobs[i]);
+            } catch (const std::exception &ex) {
+                jobs[i].error = ex.what();
+            }
+            lock.lock();
+            for (auto d : jobs[i].dependents) {
+                if (--jobs[d].waiting == 0) queue.push_back(d);
+            }
+            remaining--;
+            ready.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    auto workers = std::min<std::size_t>(std::max(1u, opts.jobs), std::max<std::size_t>(1, jobs.size()));
+    for (std::size_t t = 1; t < workers; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads) t.join();
+
+    return report_failures(jobs) ? 1 : 0;
+}
+
+void write_stamps(const std::vector<BuildJob> &jobs) {
+    for (const auto &job : jobs) {
+        if (job.skipped || job.key.empty()) continue;
+        // a stale or missing stamp only costs a rebuild, so it is written after the archives
+        std::ofstream out(stamp_path(job.output), std::ios::trunc);
+        out << job.key << "\n" << read_chain_tail(job.output) << "\n";
+    }
+}
+}
+
+int build_main(int argc, char **argv) {
+    BuildOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--manifest" && i + 1 < argc) {
+            opts.manifest = argv[++i];
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            opts.outDir = argv[++i];
+        } else if (arg == "--load" && i + 1 < argc) {
+            opts.loadPaths.push_back(argv[++i]);
+        } else if (arg == "--load-conflict" && i + 1 < argc) {
+            if (!parse_seed_conflict(argv[++i], opts.loadConflict)) {
+                build_usage();
+                return 1;
+            }
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--graph") {
+            opts.graph = true;
+        } else if (arg == "--cache") {
+            opts.cache = true;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            opts.cache = true;
+            opts.cacheDir = argv[++i];
+        } else if (arg == "--no-prune") {
+            opts.prune = false;
+        } else if (arg == "--pin-builtins") {
+            opts.pinBuiltins = true;
+        } else if (arg == "--verbose") {
+            opts.verbose = true;
+        } else if (arg == "--materialize-optionals") {
+            opts.materializeOptional = true;
+        } else if (arg == "--deterministic") {
+            opts.deterministic = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            opts.inputs.push_back(arg);
+        } else {
+            build_usage();
+            return 1;
+        }
+    }
+    if (opts.inputs.empty() && !opts.manifest) {
+        build_usage();
+        return 1;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    try {
+        auto cfg = load_config(false);
+        std::vector<BuildJob> jobs;
+        if (opts.manifest) jobs = read_manifest(*opts.manifest, opts);
+        for (const auto &input : opts.inputs) {
+            BuildJob job;
+            job.input = input;
+            job.output = output_for(input, opts);
+            job.loadPaths = opts.loadPaths;
+            jobs.push_back(std::move(job));
+        }
+        std::set<std::string> outputs;
+        for (const auto &job : jobs) {
+            if (!outputs.insert(normalized(job.output)).second) {
+                throw std::runtime_error("Two inputs write the same archive: " + job.output);
+            }
+        }
+        if (opts.outDir) std::filesystem::create_directories(*opts.outDir);
+
+        std::optional<BuildCache> cache;
+        if (opts.cache) cache.emplace(opts.cacheDir ? std::filesystem::path(*opts.cacheDir) : BuildCache::default_dir());
+        const BuildCache *cachePtr = cache ? &*cache : nullptr;
+
+        ArchiveBatch batch;
+        int rc = opts.graph ? run_graph(jobs, cfg, opts, batch, cachePtr) : run_flat(jobs, cfg, opts, batch, cachePtr);
+        // nothing is committed unless every archive built; staged temp files are discarded
+        if (rc != 0) return rc;
+        batch.commit();
+        if (opts.graph) write_stamps(jobs);
+        if (cache) {
+            for (const auto &job : jobs) {
+                if (!job.cacheKey.empty() && !job.cacheHit && !job.skipped) cache->store(job.cacheKey, job.output);
+            }
+        }
+        if (opts.verbose) {
+            std::size_t skipped = 0;
+            for (const auto &job : jobs) {
+                if (job.skipped) {
+                    skipped++;
+                    std::cout << "[up-to-date] " << job.output << "\n";
+                } else if (job.cacheHit) {
+                    std::cout << "[cached] " << job.input << " -> " << job.output << "\n";
+                } else {
+                    std::cout << "[build] " << job.input << " -> " << job.output << "\n";
+                }
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+            std::cout << "built " << (jobs.size() - skipped) << " archive(s), " << skipped << " up to date, in " << elapsed.count() << " ms\n";
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// `vaultc build`: compiles many .vau scripts in one process. argv[0] is "build".
+int build_main(int argc, char **argv);
@@ -0,0 +1,73 @@
+#include "cache.h"
+
+#include "config.h"
+#include "crypto.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+namespace {
+// Bump when the interpreter or archive format changes what a script compiles to.
+constexpr const char *kToolchainVersion = "vaultc-archive-1";
+
+bool block_uses_builtins(const std::vector<Statement> &body) {
+    for (const auto &s : body) {
+        if ((s.type == StatementType::Store || s.type == StatementType::Replace) && s.value.kind == ValueKind::Builtin) return true;
+        if (s.type == StatementType::If && block_uses_builtins(s.conditional.body)) return true;
+    }
+    return false;
+}
+}
+
+bool uses_builtins(const std::vector<VaultBlock> &program) {
+    for (const auto &vault : program) {
+        if (block_uses_builtins(vault.body)) return true;
+    }
+    return false;
+}
+
+std::string cache_key(const std::string &scriptPath, const std::vector<std::string> &seedHmacs,
+                      const std::vector<std::string> &dependencies, const VaultConfig &cfg, const std::string &flags) {
+    std::ifstream in(scriptPath, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read script: " + scriptPath);
+    std::ostringstream script;
+    script << in.rdbuf();
+
+    std::ostringstream material;
+    material << "toolchain " << kToolchainVersion << "\n";
+    // keyed fingerprint: identifies the key pair without putting either in the cache key material
+    material << "keys " << crypto::digest("vault-cache-fingerprint\n" + cfg.token, cfg.masterKey) << "\n";
+    material << "script " << crypto::digest(script.str()) << "\n";
+    for (const auto &h : seedHmacs) material << "seed " << h << "\n";
+    for (const auto &d : dependencies) material << "depends " << d << "\n";
+    material << "flags " << flags << "\n";
+    return crypto::digest(material.str());
+}
+
+BuildCache::BuildCache(std::filesystem::path dir) : dir_(std::move(dir)) {}
+
+std::filesystem::path BuildCache::default_dir() {
+    return std::filesystem::path(".vault") / "cache";
+}
+
+std::optional<std::string> BuildCache::lookup(const std::string &key) const {
+    auto path = dir_ / (key + ".svau");
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) return std::nullopt;
+    return path.string();
+}
+
+void BuildCache::store(const std::string &key, const std::string &archivePath) const {
+    std::filesystem::create_directories(dir_);
+    auto dest = dir_ / (key + ".svau");
+    auto tid = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    auto temp = dir_ / (key + ".svau.tmp-" + std::to_string(tid));
+    std::error_code ec;
+    std::filesystem::remove(temp, ec);
+    std::filesystem::create_hard_link(archivePath, temp, ec);
+    if (ec) std::filesystem::copy_file(archivePath, temp, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::rename(temp, dest);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "ast.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct VaultConfig;
+
+// Scripts whose output depends on now()/generate() are only cacheable when pinned.
+bool uses_builtins(const std::vector<VaultBlock> &program);
+
+// Content key over everything that determines a compiled archive: script bytes, seed archive
+// MACs and names, a fingerprint of the configured keys, interpreter flags and toolchain version.
+std::string cache_key(const std::string &scriptPath, const std::vector<std::string> &seedHmacs,
+                      const std::vector<std::string> &dependencies, const VaultConfig &cfg, const std::string &flags);
+
+// Content-addressed store of compiled archives, one <key>.svau file per entry.
+class BuildCache {
+  public:
+    explicit BuildCache(std::filesystem::path dir);
+
+    std::optional<std::string> lookup(const std::string &key) const;
+    // Links (or copies) a committed archive into the cache under key.
+    void store(const std::string &key, const std::string &archivePath) const;
+
+    static std::filesystem::path default_dir();
+
+  private:
+    std::filesystem::path dir_;
+};
@@ -1,12 +1,28 @@
+#include "analysis.h"
+#include "archive.h"
+#include "archive_index.h"
 #include "ast.h"
+#include "build.h"
+#include "cache.h"
+#include "config.h"
 #include "crypto.h"
+#include "import.h"
+#include "inspect.h"
 #include "interpreter.h"
 #include "lexer.h"
 #include "parser.h"
+#include "diff.h"
+#include "query.h"
+#include "rekey.h"
+#include "seed.h"
+#include "shard.h"
+#include "verify.h"
+#include "watch.h"
 
 #include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <optional>
@@ -15,83 +31,40 @@
 #include <vector>
 #include <cstdlib>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 namespace {
 std::string default_output(const std::string &input) {
     auto path = std::filesystem::path(input);
     return path.replace_extension(".svau").string();
 }
 
-struct VaultConfig {
-    std::string masterKey;
-    std::string token;
-    std::vector<std::string> securityQuestions;
-    std::vector<std::string> securityDigests;
-    std::vector<std::string> securityAnswers;
-};
-
-struct LoadedArchive {
-    std::string token;
-    std::string hmac;
-    std::vector<std::string> dependencies;
-    std::vector<SealedVault> vaults;
-};
-
 struct PlainEntry {
     std::string registry;
     std::string key;
-    std::string value;
+    SecureString value;
     std::string mac;
 };
 
-void print_plain(const LoadedArchive &archive, bool hideMac) {
-    std::cout << "# Vault Archive (decrypted view)\n";
-    if (!archive.dependencies.empty()) {
-        std::cout << "depends";
-        for (const auto &d : archive.dependencies) std::cout << " " << d;
-        std::cout << "\n";
-    }
-    for (const auto &v : archive.vaults) {
-        std::cout << "vault " << v.name << "\n";
-        for (const auto &regPair : v.registries) {
-            const auto &regName = regPair.first;
-            std::cout << "  registry " << regName << "\n";
-            for (const auto &entryPair : regPair.second.entries) {
-                const auto &key = entryPair.first;
-                const auto &entry = entryPair.second;
-                std::string plain = v.sealed
-                    ? crypto::decrypt(entry.cipher, v.masterKeyHex, regName + ":" + key)
-                    : entry.cipher;
-                if (hideMac || !v.sealed) {
-                    std::cout << "    " << key << " = \"" << plain << "\"\n";
-                } else {
-                    std::cout << "    " << key << " = \"" << plain << "\" (mac=" << entry.digest << ")\n";
-                }
-            }
-        }
-        std::cout << "---\n";
-    }
-}
-
-std::vector<std::string> sorted_unique(std::vector<std::string> vals) {
-    std::sort(vals.begin(), vals.end());
-    vals.erase(std::unique(vals.begin(), vals.end()), vals.end());
-    return vals;
-}
-
-std::vector<PlainEntry> decrypt_entries(const LoadedArchive &archive) {
+// Decrypts only the entries whose key `wanted` accepts.
+std::vector<PlainEntry> decrypt_entries(const LoadedArchive &archive, const std::function<bool(const std::string &)> &wanted) {
     std::vector<PlainEntry> out;
     for (const auto &v : archive.vaults) {
         for (const auto &regPair : v.registries) {
             const auto &regName = regPair.first;
-            for (const auto &entryPair : regPair.second.entries) {
+            for (const auto &entryPair : regPair.second->entries) {
                 const auto &key = entryPair.first;
+                if (!wanted(key)) continue;
                 const auto &entry = entryPair.second;
                 PlainEntry p;
                 p.registry = regName;
                 p.key = key;
                 p.value = v.sealed
                     ? crypto::decrypt(entry.cipher, v.masterKeyHex, regName + ":" + key)
-                    : entry.cipher;
+                    : SecureString(entry.cipher.begin(), entry.cipher.end());
                 p.mac = entry.digest;
                 out.push_back(std::move(p));
             }
@@ -100,18 +73,36 @@ std::vector<PlainEntry> decrypt_entries(const LoadedArchive &archive) {
     return out;
 }
 
-std::optional<std::string> extract_field(const std::string &doc, const std::string &field) {
+// Quoted or bare arguments of a `find::` call, split on commas.
+std::vector<std::string> call_arguments(const std::string &inside) {
+    std::vector<std::string> args;
+    std::string current;
+    bool quoted = false;
+    for (char c : inside) {
+        if (c == '"') {
+            quoted = !quoted;
+        } else if (c == ',' && !quoted) {
+            args.push_back(current);
+            current.clear();
+        } else if (quoted || c != ' ') {
+            current.push_back(c);
+        }
+    }
+    if (!current.empty() || !args.empty()) args.push_back(current);
+    return args;
+}
+
+std::optional<std::string> extract_field(const SecureString &doc, const std::string &field) {
     // naive extraction: looks for field: number or field: "string"
     std::regex numRe(field + "\\s*:\\s*([-+]?[0-9]+(?:\\.[0-9]+)?)");
     std::regex strRe(field + "\\s*:\\s*\"([^\"]*)\"");
-    std::smatch m;
+    std::match_results<SecureString::const_iterator> m;
     if (std::regex_search(doc, m, numRe) && m.size() > 1) return m[1].str();
     if (std::regex_search(doc, m, strRe) && m.size() > 1) return m[1].str();
     return std::nullopt;
 }
 
 void run_script(const std::string &path, const LoadedArchive &archive) {
-    auto entries = decrypt_entries(archive);
     std::ifstream in(path);
     if (!in) throw std::runtime_error("Unable to read script: " + path);
     std::string line;
@@ -121,10 +112,12 @@ void run_script(const std::string &path, const LoadedArchive &archive) {
     }
     if (lines.empty()) return;
 
-    // Very small DSL: for idx, var in document:find::matching("substr"):
+    // Very small DSL: for idx, var in document:find::<query>:
     //   log(var.field)
+    // where <query> is matching("substr"), prefix("p") or range("from", "to"); prefix and
+    // range visit keys in sorted order.
     auto header = lines.front();
-    auto colon = header.find(":find::matching(");
+    auto colon = header.find(":find::");
     if (header.rfind("for ", 0) != 0 || colon == std::string::npos) {
         throw std::runtime_error("Unsupported script header");
     }
@@ -139,18 +132,36 @@ void run_script(const std::string &path, const LoadedArchive &archive) {
     idxVar.erase(idxVar.find_last_not_of(' ') + 1);
     docVar.erase(0, docVar.find_first_not_of(' '));
     docVar.erase(docVar.find_last_not_of(' ') + 1);
-    auto matchStart = colon + std::string(":find::matching(").size();
-    auto end = header.find(')', matchStart);
-    if (end == std::string::npos) throw std::runtime_error("Bad matching() syntax");
-    auto needle = header.substr(matchStart, end - matchStart);
-    if (!needle.empty() && needle.front() == '"' && needle.back() == '"') {
-        needle = needle.substr(1, needle.size() - 2);
+    auto nameStart = colon + std::string(":find::").size();
+    auto open = header.find('(', nameStart);
+    auto end = header.rfind(')');
+    if (open == std::string::npos || end == std::string::npos || end < open) throw std::runtime_error("Bad find:: syntax");
+    auto query = header.substr(nameStart, open - nameStart);
+    auto args = call_arguments(header.substr(open + 1, end - open - 1));
+
+    std::vector<PlainEntry> entries;
+    if (query == "matching") {
+        if (args.size() > 1) throw std::runtime_error("matching() takes one argument");
+        auto needle = args.empty() ? std::string() : args.front();
+        entries = decrypt_entries(archive, [&](const std::string &key) { return key.find(needle) != std::string::npos; });
+    } else if (query == "prefix" || query == "range") {
+        KeyRange range;
+        if (query == "prefix") {
+            if (args.size() != 1) throw std::runtime_error("prefix() takes one argument");
+            range = KeyRange::prefix(args[0]);
+        } else {
+            if (args.size() != 2) throw std::runtime_error("range() takes two arguments");
+            range = KeyRange{args[0], args[1]};
+        }
+        entries = decrypt_entries(archive, [&](const std::string &key) { return range.contains(key); });
+        std::stable_sort(entries.begin(), entries.end(), [](const PlainEntry &a, const PlainEntry &b) { return a.key < b.key; });
+    } else {
+        throw std::runtime_error("Unsupported query: find::" + query);
     }
 
     std::vector<std::string> body(lines.begin() + 1, lines.end());
     int idx = 0;
     for (const auto &e : entries) {
-        if (e.key.find(needle) == std::string::npos) continue;
         for (const auto &b : body) {
             auto trimmed = b;
             trimmed.erase(0, trimmed.find_first_not_of(' '));
@@ -171,192 +182,51 @@ void run_script(const std::string &path, const LoadedArchive &archive) {
     }
 }
 
-VaultConfig load_config(bool requireSecurity) {
-    auto path = std::filesystem::path(".vault") / "var.vc";
-    if (!std::filesystem::exists(path)) {
-        throw std::runtime_error("Missing config: " + path.string());
-    }
-    VaultConfig cfg;
-    std::ifstream in(path);
-    if (!in) throw std::runtime_error("Unable to read config: " + path.string());
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
-        auto eq = line.find('=');
-        if (eq == std::string::npos) continue;
-        auto key = line.substr(0, eq);
-        auto val = line.substr(eq + 1);
-        if (key == "MASTER_KEY") cfg.masterKey = val;
-        if (key == "TOKEN") cfg.token = val;
-        if (key == "SECURITY_Q1" || key == "SECURITY_Q2" || key == "SECURITY_Q3") {
-            cfg.securityQuestions.push_back(val);
-        }
-        if (key == "SECURITY_Q4") {
-            cfg.securityQuestions.push_back(val);
-            std::cerr << "Warning: SECURITY_Q4 present; only 3 are recommended\n";
-        }
-        if (key == "SECURITY_A1_DIGEST" || key == "SECURITY_A2_DIGEST" || key == "SECURITY_A3_DIGEST" || key == "SECURITY_A4_DIGEST") {
-            cfg.securityDigests.push_back(val);
-        }
-        if (key == "SECURITY_A1" || key == "SECURITY_A2" || key == "SECURITY_A3" || key == "SECURITY_A4") {
-            cfg.securityAnswers.push_back(val);
-        }
-    }
-    if (cfg.masterKey.empty() || cfg.token.empty()) {
-        throw std::runtime_error("Config incomplete: require MASTER_KEY and TOKEN in .vault/var.vc");
-    }
-    // Enforce up to 3 security answers only when explicitly requested (lost-mode recovery).
-    if (requireSecurity) {
-        if (cfg.securityQuestions.size() > 3) {
-            std::cerr << "Warning: more than 3 security questions; only first 3 are recommended\n";
-        }
-        std::size_t maxCount = std::max(cfg.securityDigests.size(), cfg.securityAnswers.size());
-        if (maxCount == 0) {
-            throw std::runtime_error("Security questions/answers required in lost mode");
-        }
-        if (maxCount > 4) {
-            std::cerr << "Warning: more than 4 security entries found; extra will be ignored\n";
-            maxCount = 4;
-        }
-        for (std::size_t i = 0; i < maxCount; ++i) {
-            std::string digest;
-            if (i < cfg.securityDigests.size()) digest = cfg.securityDigests[i];
-            if (i < cfg.securityAnswers.size()) {
-                auto computed = crypto::digest(cfg.securityAnswers[i], cfg.masterKey);
-                if (!digest.empty() && digest != computed) {
-                    throw std::runtime_error("Security answer digest mismatch for slot " + std::to_string(i + 1));
-                }
-                digest = computed;
-            }
-            if (digest.empty()) {
-                throw std::runtime_error("Missing security answer/digest for slot " + std::to_string(i + 1));
-            }
-            // At this point digest is validated/derived; nothing more to store.
-        }
-    }
-    return cfg;
-}
 
-void write_svau(std::ostream &out, const std::vector<SealedVault> &vaults, const std::string &token, const std::vector<std::string> &dependencies) {
-    out << "# Vault Secure Archive\n";
-    auto deps = sorted_unique(dependencies);
-    for (const auto &d : deps) out << "depends " << d << "\n";
-    // hmac is written separately after computation
-    for (const auto &v : vaults) {
-        out << "vault " << v.name << " (" << (v.optional ? "optional" : "required") << ")\n";
-        out << "sealed " << (v.sealed ? "true" : "false") << "\n";
-        std::vector<std::string> registryNames;
-        registryNames.reserve(v.registries.size());
-        for (const auto &regPair : v.registries) registryNames.push_back(regPair.first);
-        std::sort(registryNames.begin(), registryNames.end());
-        for (const auto &regName : registryNames) {
-            const auto &reg = v.registries.at(regName);
-            out << "  registry " << regName << "\n";
-            std::vector<std::string> entryNames;
-            entryNames.reserve(reg.entries.size());
-            for (const auto &entry : reg.entries) entryNames.push_back(entry.first);
-            std::sort(entryNames.begin(), entryNames.end());
-            for (const auto &entryName : entryNames) {
-                const auto &entry = reg.entries.at(entryName);
-                out << "    entry " << entryName << "\n";
-                out << "      digest " << entry.digest << "\n";
-                out << "      cipher " << entry.cipher << "\n";
+// A script read from `in` (stdin for `-`) as it arrives: each top-level block is lexed, parsed
+// and pruned when the next one starts, and blocks are evaluated `jobs` at a time, so a
+// generator piping a script in overlaps with parsing and sealing. The result matches
+// Interpreter::run on the whole script.
+std::vector<SealedVault> run_streamed(std::istream &in, Interpreter &interp, const std::vector<std::string> &seeded, bool prune,
+                                      const InterpreterOptions &opts) {
+    BlockLexer lexer(in);
+    ProgramPruner pruner(seeded, opts.materializeOptional);
+    std::vector<SealedVault> out;
+    std::vector<VaultBlock> pending;
+    std::vector<Line> lines;
+    std::size_t resolved = 0;
+    auto flush = [&]() {
+        if (pending.empty()) return;
+        if (prune) {
+            auto report = pruner.prune(pending);
+            resolved += report.resolved;
+            if (opts.verbose) {
+                for (auto line : report.unreachable) std::cout << "[unreachable] line " << line << "\n";
             }
         }
-        out << "---\n";
-    }
-}
-
-void write_svau_file(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token, const std::vector<std::string> &dependencies) {
-    std::ofstream out(outPath, std::ios::trunc);
-    if (!out) throw std::runtime_error("Unable to write: " + outPath);
-    write_svau(out, vaults, token, dependencies);
-}
-
-std::string compute_archive_hmac(const std::vector<SealedVault> &vaults, const std::string &token, const std::string &masterKeyHex, const std::vector<std::string> &dependencies) {
-    // deterministic serialization (token is implicit secret; not written to archive)
-    std::ostringstream oss;
-    oss << "token " << token << "\n";
-    auto deps = sorted_unique(dependencies);
-    for (const auto &d : deps) oss << "depends " << d << "\n";
-    for (const auto &v : vaults) {
-        oss << "vault " << v.name << " (" << (v.optional ? "optional" : "required") << ")\n";
-        oss << "sealed " << (v.sealed ? "true" : "false") << "\n";
-        std::vector<std::string> registryNames;
-        registryNames.reserve(v.registries.size());
-        for (const auto &regPair : v.registries) registryNames.push_back(regPair.first);
-        std::sort(registryNames.begin(), registryNames.end());
-        for (const auto &regName : registryNames) {
-            const auto &reg = v.registries.at(regName);
-            oss << "  registry " << regName << "\n";
-            std::vector<std::string> entryNames;
-            entryNames.reserve(reg.entries.size());
-            for (const auto &entry : reg.entries) entryNames.push_back(entry.first);
-            std::sort(entryNames.begin(), entryNames.end());
-            for (const auto &entryName : entryNames) {
-                const auto &entry = reg.entries.at(entryName);
-                oss << "    entry " << entryName << "\n";
-                oss << "      digest " << entry.digest << "\n";
-                oss << "      cipher " << entry.cipher << "\n";
-            }
+        for (auto &v : interp.evaluate(pending)) {
+            if (v) out.push_back(std::move(*v));
         }
-        oss << "---\n";
-    }
-    return crypto::digest(oss.str(), masterKeyHex);
-}
-
-LoadedArchive read_svau(const std::string &path) {
-    std::ifstream in(path);
-    if (!in) throw std::runtime_error("Unable to read: " + path);
-    LoadedArchive result;
-    std::vector<SealedVault> vaults;
-    std::string line;
-    SealedVault current;
-    std::string currentReg;
-    std::string currentEntryKey;
-    auto flush = [&]() {
-        if (!current.name.empty()) vaults.push_back(current);
-        current = SealedVault{};
-        currentReg.clear();
+        pending.clear();
     };
-
-    while (std::getline(in, line)) {
-        if (line == "---") { flush(); continue; }
-        if (line.empty() || line == "# Vault Secure Archive") continue;
-        if (line.rfind("hmac ", 0) == 0) { result.hmac = line.substr(5); continue; }
-        if (line.rfind("depends ", 0) == 0) { result.dependencies.push_back(line.substr(8)); continue; }
-        if (line.rfind("token ", 0) == 0) { result.token = line.substr(6); continue; }
-        if (line.rfind("vault ", 0) == 0) {
-            flush();
-            std::istringstream iss(line.substr(6));
-            std::string name, paren;
-            iss >> name;
-            current.name = name;
-            auto pos = line.find('(');
-            current.optional = (pos != std::string::npos && line.find("optional") != std::string::npos);
-        } else if (line.rfind("sealed ", 0) == 0) {
-            current.sealed = (line.find("true") != std::string::npos);
-        } else if (line.rfind("  registry ", 0) == 0) {
-            currentReg = line.substr(11);
-            current.registries[currentReg] = SealedRegistry{};
-        } else if (line.rfind("    entry ", 0) == 0) {
-            currentEntryKey = line.substr(10);
-            current.registries[currentReg].entries[currentEntryKey] = SealedEntry{};
-        } else if (line.rfind("      digest ", 0) == 0) {
-            auto &entry = current.registries[currentReg].entries[currentEntryKey];
-            entry.digest = line.substr(13);
-        } else if (line.rfind("      cipher ", 0) == 0) {
-            auto &entry = current.registries[currentReg].entries[currentEntryKey];
-            entry.cipher = line.substr(13);
-        }
+    while (lexer.next(lines)) {
+        for (auto &block : Parser(std::move(lines)).parse()) pending.push_back(std::move(block));
+        if (pending.size() >= std::max(1u, opts.jobs)) flush();
     }
     flush();
-    result.vaults = std::move(vaults);
-    return result;
+    if (prune && opts.verbose) std::cout << "[prune] " << resolved << " condition(s) resolved statically\n";
+    return out;
 }
 
 void usage() {
-    std::cerr << "Usage: vaultc <input.vau|input.svau|input.vsc> [--out file.svau] [--stdout] [--hide-mac] [--load file.svau] [--verbose] [--materialize-optionals] [--lost]\n";
+    std::cerr << "Usage: vaultc <input.vau|-|input.svau|input.vsc> [--out file.svau] [--stdout] [--hide-mac] [--output text|json|ndjson|binary] [--load file.svau ...] [--load-conflict error|first|last] [--verbose] [--materialize-optionals] [--deterministic] [--jobs n] [--no-prune] [--shards n] [--watch] [--lost] [--append] [--compact] [--cache] [--cache-dir dir] [--pin-builtins]\n";
+    std::cerr << "       vaultc build <a.vau> [b.vau ...] [--manifest file] [--out-dir dir] [--load file.svau ...] [--load-conflict error|first|last] [--jobs n] [--graph] [--cache] [--verbose] [--materialize-optionals] [--deterministic]\n";
+    std::cerr << "       vaultc query <archive.svau> --registry r [--vault v] [--key k | --prefix p | --range from to] [--limit n] [--cursor c] [--keys-only] [--output text|ndjson]\n";
+    std::cerr << "       vaultc rekey <in.svau> <out.svau> --new-key-env NAME [--old-key-env NAME] [--jobs n] [--batch n] [--deterministic] [--verbose]\n";
+    std::cerr << "       vaultc diff <old.svau> <new.svau> [--vault v] [--registry r] [--decrypt] [--output text|ndjson]\n";
+    std::cerr << "       vaultc merge <ours.svau> <theirs.svau> --out merged.svau [--base base.svau] [--prefer ours|theirs] [--decrypt] [--output text|ndjson]\n";
+    std::cerr << "       vaultc import <data.ndjson|data.csv|-> [...] --vault v --registry r --out file.svau [--load file.svau] [--replace] [--format ndjson|csv] [--jobs n] [--batch n] [--deterministic] [--verbose]\n";
+    std::cerr << "       vaultc verify <dir|archive.svau> [...] [--jobs n] [--failures-only] [--output text|ndjson]\n";
 }
 }
 
@@ -365,16 +235,33 @@ int vaultc_main(int argc, char **argv) {
         usage();
         return 1;
     }
+    if (std::string(argv[1]) == "build") return build_main(argc - 1, argv + 1);
+    if (std::string(argv[1]) == "query") return query_main(argc - 1, argv + 1);
+    if (std::string(argv[1]) == "rekey") return rekey_main(argc - 1, argv + 1);
+    if (std::string(argv[1]) == "diff") return diff_main(argc - 1, argv + 1);
+    if (std::string(argv[1]) == "merge") return merge_main(argc - 1, argv + 1);
+    if (std::string(argv[1]) == "import") return import_main(argc - 1, argv + 1);
+    if (std::string(argv[1]) == "verify") return verify_main(argc - 1, argv + 1);
 
     std::string input = argv[1];
     std::string output = default_output(input);
     InterpreterOptions opts{};
     bool emitStdout = true;
-    std::optional<std::string> loadPath;
+    std::vector<std::string> loadPaths;
+    SeedConflict loadConflict = SeedConflict::Error;
     bool inputIsSvau = std::filesystem::path(input).extension() == ".svau";
     bool inputIsVsc = std::filesystem::path(input).extension() == ".vsc";
     bool hideMac = false;
+    InspectFormat inspectFormat = InspectFormat::Text;
     bool requireSecurity = false;
+    bool appendSegment = false;
+    bool compact = false;
+    bool useCache = false;
+    bool pinBuiltins = false;
+    bool prune = true;
+    bool watch = false;
+    std::size_t shards = 0; // 0: one archive file
+    std::optional<std::string> cacheDir;
     std::vector<std::string> dependencies;
 
     for (int i = 2; i < argc; ++i) {
@@ -386,78 +273,183 @@ int vaultc_main(int argc, char **argv) {
             emitStdout = true;
         } else if (arg == "--hide-mac") {
             hideMac = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            if (!parse_inspect_format(argv[++i], inspectFormat)) {
+                std::cerr << "Error: --output expects text, json, ndjson or binary\n";
+                return 1;
+            }
         } else if (arg == "--load" && i + 1 < argc) {
-            loadPath = argv[++i];
+            loadPaths.push_back(argv[++i]);
+        } else if (arg == "--load-conflict" && i + 1 < argc) {
+            if (!parse_seed_conflict(argv[++i], loadConflict)) {
+                std::cerr << "Error: --load-conflict expects error, first or last\n";
+                return 1;
+            }
         } else if (arg == "--verbose") {
             opts.verbose = true;
         } else if (arg == "--materialize-optionals") {
             opts.materializeOptional = true;
+        } else if (arg == "--deterministic") {
+            opts.deterministic = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--no-prune") {
+            prune = false;
+        } else if (arg == "--shards" && i + 1 < argc) {
+            shards = static_cast<std::size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--watch") {
+            watch = true;
         } else if (arg == "--lost") {
             requireSecurity = true;
+        } else if (arg == "--append") {
+            appendSegment = true;
+        } else if (arg == "--compact") {
+            compact = true;
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            useCache = true;
+            cacheDir = argv[++i];
+        } else if (arg == "--pin-builtins") {
+            pinBuiltins = true;
         } else {
             usage();
             return 1;
         }
     }
 
+    if (shards && ((emitStdout && !compact) || watch || useCache || appendSegment)) {
+        std::cerr << "Error: --shards requires --out and cannot be combined with --watch, --cache or --append\n";
+        return 1;
+    }
+
+    if (watch) {
+        if (inputIsSvau || inputIsVsc || input == "-") {
+            std::cerr << "Error: --watch requires a script input (.vau)\n";
+            return 1;
+        }
+        if (loadPaths.size() > 1) {
+            std::cerr << "Error: --watch takes at most one --load\n";
+            return 1;
+        }
+        WatchOptions watchOpts;
+        watchOpts.input = input;
+        watchOpts.output = output;
+        if (!loadPaths.empty()) watchOpts.loadPath = loadPaths.front();
+        watchOpts.interp = opts;
+        watchOpts.prune = prune;
+        watchOpts.requireSecurity = requireSecurity;
+        return watch_main(watchOpts);
+    }
+
     try {
         auto cfg = load_config(requireSecurity);
         if (inputIsSvau) {
-            auto archive = read_svau(input);
-            // token is not stored for new archives; accept only if present and matching
-            if (!archive.token.empty() && archive.token != cfg.token) {
-                throw std::runtime_error("Token mismatch for archive");
-            }
-            // inject master key (not stored in archive) and verify hmac using current token
-            for (auto &v : archive.vaults) v.masterKeyHex = cfg.masterKey;
-            auto want = compute_archive_hmac(archive.vaults, cfg.token, cfg.masterKey, archive.dependencies);
-            if (!archive.hmac.empty() && archive.hmac != want) {
-                throw std::runtime_error("Archive HMAC verification failed");
-            }
+            auto archive = open_archive(input, cfg);
             dependencies = archive.dependencies;
-            print_plain(archive, hideMac);
-        } else if (inputIsVsc) {
-            if (!loadPath) throw std::runtime_error("Script requires --load <archive.svau>");
-            auto archive = read_svau(*loadPath);
-            if (archive.token != cfg.token) throw std::runtime_error("Token mismatch for archive");
-            for (auto &v : archive.vaults) v.masterKeyHex = cfg.masterKey;
-            auto want = compute_archive_hmac(archive.vaults, archive.token, cfg.masterKey, archive.dependencies);
-            if (!archive.hmac.empty() && archive.hmac != want) {
-                throw std::runtime_error("Archive HMAC verification failed");
+            if (compact) {
+                // fold the replayed view into a fresh base archive without segments
+                if (shards) {
+                    write_sharded_file(output, archive.vaults, cfg.token, cfg.masterKey, dependencies, shards);
+                } else {
+                    auto hmac = compute_archive_hmac(archive.vaults, cfg.token, cfg.masterKey, dependencies);
+                    write_svau_file(output, archive.vaults, cfg.token, cfg.masterKey, dependencies, hmac);
+                }
+                if (opts.verbose) std::cout << "compacted " << archive.segments.size() << " segment(s) into " << output << "\n";
+                return 0;
             }
+#ifdef _WIN32
+            // keep binary records and embedded newlines byte-exact
+            if (inspectFormat != InspectFormat::Text) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            write_inspect(std::cout, archive, inspectFormat, hideMac);
+        } else if (inputIsVsc) {
+            if (loadPaths.empty()) throw std::runtime_error("Script requires --load <archive.svau>");
+            auto archive = open_seeds(loadPaths, cfg, loadConflict);
             dependencies = archive.dependencies;
             run_script(input, archive);
         } else {
-            auto lines = lex_file(input);
-            Parser parser(lines);
-            auto program = parser.parse();
+            if (compact) throw std::runtime_error("--compact requires an archive input (.svau)");
+            if (appendSegment && loadPaths.size() != 1) throw std::runtime_error("--append requires exactly one --load <archive.svau>");
+            if (appendSegment && is_shard_manifest(loadPaths.front())) throw std::runtime_error("--append does not support sharded archives; recompile with --shards");
+            // `-` reads the script from stdin and runs it block by block as it arrives
+            bool streamed = input == "-";
+            if (streamed && useCache) throw std::runtime_error("--cache requires a script file, not stdin");
+            std::vector<VaultBlock> program;
+            if (!streamed) program = Parser(lex_file(input)).parse();
             opts.forcedMasterKey = cfg.masterKey;
             Interpreter interp(opts);
-            if (loadPath) {
-                auto seedArchive = read_svau(*loadPath);
-                if (!seedArchive.token.empty() && seedArchive.token != cfg.token) {
-                    throw std::runtime_error("Token mismatch for loaded archive");
+            LoadedArchive seedArchive;
+            if (!loadPaths.empty()) {
+                seedArchive = open_seeds(loadPaths, cfg, loadConflict);
+                dependencies = seed_dependencies(seedArchive, loadPaths);
+                interp.seed(seedArchive.vaults);
+            }
+            std::vector<std::string> seeded;
+            for (const auto &v : seedArchive.vaults) seeded.push_back(v.name);
+            if (prune && !streamed) {
+                auto report = prune_program(program, seeded, opts.materializeOptional);
+                if (opts.verbose) {
+                    for (auto line : report.unreachable) std::cout << "[unreachable] line " << line << "\n";
+                    std::cout << "[prune] " << report.resolved << " condition(s) resolved statically\n";
                 }
-                for (auto &v : seedArchive.vaults) v.masterKeyHex = cfg.masterKey;
-                auto want = compute_archive_hmac(seedArchive.vaults, cfg.token, cfg.masterKey, seedArchive.dependencies);
-                if (!seedArchive.hmac.empty() && seedArchive.hmac != want) {
-                    throw std::runtime_error("Loaded archive HMAC verification failed");
+            }
+            std::optional<BuildCache> cache;
+            std::string cacheKey;
+            if (useCache && !appendSegment && (pinBuiltins || !uses_builtins(program))) {
+                cache.emplace(cacheDir ? std::filesystem::path(*cacheDir) : BuildCache::default_dir());
+                std::vector<std::string> seedHmacs;
+                if (!loadPaths.empty()) seedHmacs.push_back(content_hmac(seedArchive, cfg.token, cfg.masterKey));
+                std::string flags = opts.materializeOptional ? "materialize-optionals" : "";
+                if (opts.deterministic) flags += " deterministic";
+                cacheKey = cache_key(input, seedHmacs, dependencies, cfg, flags);
+                if (auto hit = cache->lookup(cacheKey)) {
+                    if (emitStdout) {
+                        std::ifstream in(*hit, std::ios::binary);
+                        std::cout << in.rdbuf();
+                    } else {
+                        ArchiveBatch batch;
+                        batch.add_file(output, *hit);
+                        batch.commit();
+                        if (opts.verbose) std::cout << "cached " << output << "\n";
+                    }
+                    return 0;
                 }
-                dependencies = seedArchive.dependencies;
-                dependencies.push_back(std::filesystem::path(*loadPath).filename().string());
-                dependencies = sorted_unique(std::move(dependencies));
-                interp.seed(seedArchive.vaults);
             }
-            auto sealed = interp.run(program);
+            auto sealed = streamed ? run_streamed(std::cin, interp, seeded, prune, opts) : interp.run(program);
+            if (appendSegment && !segment_expresses(seedArchive.vaults, sealed)) {
+                // vaults or keys the script no longer produces cannot be dropped by a segment;
+                // rewrite the archive as a plain compile of the script would
+                output = loadPaths.front();
+                emitStdout = false;
+                appendSegment = false;
+                if (opts.verbose) std::cout << "rewriting " << output << ": the script drops vaults or keys it holds\n";
+            }
+            if (appendSegment) {
+                // only the records that changed relative to the seed are written, as a new segment
+                auto delta = diff_vaults(seedArchive.vaults, sealed);
+                if (delta.empty()) {
+                    if (opts.verbose) std::cout << "no changes for " << loadPaths.front() << "\n";
+                    return 0;
+                }
+                int index = static_cast<int>(seedArchive.segments.size()) + 1;
+                auto hmac = compute_segment_hmac(delta, cfg.token, cfg.masterKey, index, chain_tail(seedArchive));
+                append_segment(loadPaths.front(), delta, index, hmac);
+                if (opts.verbose) std::cout << "appended segment " << index << " to " << loadPaths.front() << "\n";
+                return 0;
+            }
+            if (shards) {
+                write_sharded_file(output, sealed, cfg.token, cfg.masterKey, dependencies, shards);
+                if (opts.verbose) std::cout << "wrote " << output << " and " << shards << " shard(s)\n";
+                return 0;
+            }
             auto hmac = compute_archive_hmac(sealed, cfg.token, cfg.masterKey, dependencies);
             if (emitStdout) {
-                write_svau(std::cout, sealed, cfg.token, dependencies);
+                write_svau(std::cout, sealed, cfg.token, cfg.masterKey, dependencies);
                 std::cout << "hmac " << hmac << "\n";
             } else {
-                // write file then append hmac line
-                write_svau_file(output, sealed, cfg.token, dependencies);
-                std::ofstream out(output, std::ios::app);
-                out << "hmac " << hmac << "\n";
+                write_svau_file(output, sealed, cfg.token, cfg.masterKey, dependencies, hmac);
+                if (cache) cache->store(cacheKey, output);
                 if (opts.verbose) std::cout << "wrote " << output << "\n";
             }
         }
@@ -0,0 +1,84 @@
+#include "config.h"
+
+#include "crypto.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+VaultConfig::~VaultConfig() {
+    secure_wipe(masterKey);
+    secure_wipe(token);
+    for (auto &answer : securityAnswers) secure_wipe(answer);
+}
+
+VaultConfig load_config(bool requireSecurity) {
+    auto path = std::filesystem::path(".vault") / "var.vc";
+    if (!std::filesystem::exists(path)) {
+        throw std::runtime_error("Missing config: " + path.string());
+    }
+    VaultConfig cfg;
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Unable to read config: " + path.string());
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        auto eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        auto key = line.substr(0, eq);
+        auto val = line.substr(eq + 1);
+        if (key == "MASTER_KEY") cfg.masterKey = val;
+        if (key == "TOKEN") cfg.token = val;
+        if (key == "SECURITY_Q1" || key == "SECURITY_Q2" || key == "SECURITY_Q3") {
+            cfg.securityQuestions.push_back(val);
+        }
+        if (key == "SECURITY_Q4") {
+            cfg.securityQuestions.push_back(val);
+            std::cerr << "Warning: SECURITY_Q4 present; only 3 are recommended\n";
+        }
+        if (key == "SECURITY_A1_DIGEST" || key == "SECURITY_A2_DIGEST" || key == "SECURITY_A3_DIGEST" || key == "SECURITY_A4_DIGEST") {
+            cfg.securityDigests.push_back(val);
+        }
+        if (key == "SECURITY_A1" || key == "SECURITY_A2" || key == "SECURITY_A3" || key == "SECURITY_A4") {
+            cfg.securityAnswers.push_back(val);
+        }
+        secure_wipe(val);
+    }
+    secure_wipe(line);
+    if (cfg.masterKey.empty() || cfg.token.empty()) {
+        throw std::runtime_error("Config incomplete: require MASTER_KEY and TOKEN in .vault/var.vc");
+    }
+    // Enforce up to 3 security answers only when explicitly requested (lost-mode recovery).
+    if (requireSecurity) {
+        if (cfg.securityQuestions.size() > 3) {
+            std::cerr << "Warning: more than 3 security questions; only first 3 are recommended\n";
+        }
+        std::size_t maxCount = std::max(cfg.securityDigests.size(), cfg.securityAnswers.size());
+        if (maxCount == 0) {
+            throw std::runtime_error("Security questions/answers required in lost mode");
+        }
+        if (maxCount > 4) {
+            std::cerr << "Warning: more than 4 security entries found; extra will be ignored\n";
+            maxCount = 4;
+        }
+        for (std::size_t i = 0; i < maxCount; ++i) {
+            std::string digest;
+            if (i < cfg.securityDigests.size()) digest = cfg.securityDigests[i];
+            if (i < cfg.securityAnswers.size()) {
+                auto computed = crypto::digest(cfg.securityAnswers[i], cfg.masterKey);
+                if (!digest.empty() && digest != computed) {
+                    throw std::runtime_error("Security answer digest mismatch for slot " + std::to_string(i + 1));
+                }
+                digest = computed;
+            }
+            if (digest.empty()) {
+                throw std::runtime_error("Missing security answer/digest for slot " + std::to_string(i + 1));
+            }
+            // At this point digest is validated/derived; nothing more to store.
+        }
+    }
+    return cfg;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// The key, token and answers are wiped when the config is destroyed.
+struct VaultConfig {
+    VaultConfig() = default;
+    VaultConfig(const VaultConfig &) = default;
+    VaultConfig(VaultConfig &&) = default;
+    VaultConfig &operator=(const VaultConfig &) = default;
+    VaultConfig &operator=(VaultConfig &&) = default;
+    ~VaultConfig();
+
+    std::string masterKey;
+    std::string token;
+    std::vector<std::string> securityQuestions;
+    std::vector<std::string> securityDigests;
+    std::vector<std::string> securityAnswers;
+};
+
+// Reads .vault/var.vc from the working directory.
+VaultConfig load_config(bool requireSecurity);
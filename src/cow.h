@@ -0,0 +1,26 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+// Shared handle with copy-on-write semantics: copying a Cow shares the value, and the
+// first write() through a shared handle detaches it with a private clone. Reads never
+// copy. Handles may be copied and read from several threads; write() needs the handle
+// itself to be owned by one thread, as with any other value.
+template <typename T>
+class Cow {
+  public:
+    Cow() : ptr_(std::make_shared<T>()) {}
+    Cow(T value) : ptr_(std::make_shared<T>(std::move(value))) {}
+
+    const T &operator*() const { return *ptr_; }
+    const T *operator->() const { return ptr_.get(); }
+
+    T &write() {
+        if (ptr_.use_count() > 1) ptr_ = std::make_shared<T>(*ptr_);
+        return *ptr_;
+    }
+
+  private:
+    std::shared_ptr<T> ptr_;
+};
@@ -15,14 +15,20 @@
 #endif
 
 namespace {
-std::vector<std::uint8_t> hex_to_bytes(const std::string &hex) {
+int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    throw std::runtime_error("Bad hex key");
+}
+
+// Key bytes stay in secure memory; decoding digit by digit leaves no substr copies behind.
+SecureBytes hex_to_bytes(const std::string &hex) {
     if (hex.size() % 2 != 0) throw std::runtime_error("Bad hex key");
-    std::vector<std::uint8_t> out;
+    SecureBytes out;
     out.reserve(hex.size() / 2);
     for (std::size_t i = 0; i < hex.size(); i += 2) {
-        std::string byteStr = hex.substr(i, 2);
-        auto byte = static_cast<std::uint8_t>(std::stoul(byteStr, nullptr, 16));
-        out.push_back(byte);
+        out.push_back(static_cast<std::uint8_t>(hex_digit(hex[i]) << 4 | hex_digit(hex[i + 1])));
     }
     return out;
 }
@@ -113,12 +119,12 @@ std::string random_key_hex(std::size_t bytes) {
     return bytes_to_hex(raw);
 }
 
-std::string digest(const std::string &material, const std::string &keyHex) {
+std::string digest(std::string_view material, const std::string &keyHex) {
 #ifdef _WIN32
     BCRYPT_ALG_HANDLE alg{};
     NTSTATUS status = BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG);
     if (status < 0) throw std::runtime_error("HMAC provider open failed");
-    auto keyBytes = keyHex.empty() ? std::vector<std::uint8_t>() : hex_to_bytes(keyHex);
+    auto keyBytes = keyHex.empty() ? SecureBytes() : hex_to_bytes(keyHex);
     BCRYPT_HASH_HANDLE hash{};
     status = BCryptCreateHash(alg, &hash, nullptr, 0, keyBytes.empty() ? nullptr : keyBytes.data(), (ULONG)keyBytes.size(), 0);
     if (status < 0) { BCryptCloseAlgorithmProvider(alg,0); throw std::runtime_error("HMAC create failed"); }
@@ -135,9 +141,59 @@ std::string digest(const std::string &material, const std::string &keyHex) {
 #endif
 }
 
-std::string encrypt(const std::string &plain, const std::string &keyHex, const std::string &salt) {
+Hmac::Hmac(const std::string &keyHex) {
+#ifdef _WIN32
+    BCRYPT_ALG_HANDLE alg{};
+    NTSTATUS status = BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+    if (status < 0) throw std::runtime_error("HMAC provider open failed");
+    auto keyBytes = keyHex.empty() ? SecureBytes() : hex_to_bytes(keyHex);
+    BCRYPT_HASH_HANDLE hash{};
+    status = BCryptCreateHash(alg, &hash, nullptr, 0, keyBytes.empty() ? nullptr : keyBytes.data(), (ULONG)keyBytes.size(), 0);
+    if (status < 0) { BCryptCloseAlgorithmProvider(alg,0); throw std::runtime_error("HMAC create failed"); }
+    alg_ = alg;
+    hash_ = hash;
+#else
+    (void)keyHex;
+    throw std::runtime_error("HMAC requires Windows (bcrypt) in this build");
+#endif
+}
+
+Hmac::~Hmac() {
+#ifdef _WIN32
+    if (hash_) BCryptDestroyHash(static_cast<BCRYPT_HASH_HANDLE>(hash_));
+    if (alg_) BCryptCloseAlgorithmProvider(static_cast<BCRYPT_ALG_HANDLE>(alg_), 0);
+#endif
+}
+
+void Hmac::update(const std::string &data) {
+#ifdef _WIN32
+    if (!hash_) throw std::runtime_error("HMAC already finished");
+    NTSTATUS status = BCryptHashData(static_cast<BCRYPT_HASH_HANDLE>(hash_), (PUCHAR)data.data(), (ULONG)data.size(), 0);
+    if (status < 0) throw std::runtime_error("HMAC data failed");
+#else
+    (void)data;
+#endif
+}
+
+std::string Hmac::final() {
+#ifdef _WIN32
+    if (!hash_) throw std::runtime_error("HMAC already finished");
+    std::vector<std::uint8_t> out(32);
+    NTSTATUS status = BCryptFinishHash(static_cast<BCRYPT_HASH_HANDLE>(hash_), out.data(), (ULONG)out.size(), 0);
+    BCryptDestroyHash(static_cast<BCRYPT_HASH_HANDLE>(hash_));
+    hash_ = nullptr;
+    if (status < 0) throw std::runtime_error("HMAC finish failed");
+    return bytes_to_hex(out);
+#else
+    return {};
+#endif
+}
+
+namespace {
+// AES-GCM under keyHex with the given 12-byte nonce and salt as associated data; packs
+// iv|tag|cipher as base64.
+std::string seal(std::string_view plain, const std::string &keyHex, const std::vector<std::uint8_t> &ivBytes, const std::string &salt) {
     auto keyBytes = hex_to_bytes(keyHex);
-    auto ivBytes = random_bytes(12);
 
 #ifdef _WIN32
     BCRYPT_ALG_HANDLE alg{};
@@ -152,7 +208,7 @@ std::string encrypt(const std::string &plain, const std::string &keyHex, const s
 
     BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO gcmInfo;
     BCRYPT_INIT_AUTH_MODE_INFO(gcmInfo);
-    gcmInfo.pbNonce = ivBytes.data();
+    gcmInfo.pbNonce = const_cast<PUCHAR>(ivBytes.data());
     gcmInfo.cbNonce = (ULONG)ivBytes.size();
     gcmInfo.pbAuthData = (PUCHAR)salt.data();
     gcmInfo.cbAuthData = (ULONG)salt.size();
@@ -178,11 +234,35 @@ std::string encrypt(const std::string &plain, const std::string &keyHex, const s
     packed.append(cipher);
     return base64_encode(packed);
 #else
+    (void)plain;
+    (void)keyBytes;
+    (void)ivBytes;
+    (void)salt;
     throw std::runtime_error("AES-GCM requires Windows (bcrypt) in this build");
 #endif
 }
+}
+
+std::string encrypt(std::string_view plain, const std::string &keyHex, const std::string &salt) {
+#ifdef _WIN32
+    return seal(plain, keyHex, random_bytes(12), salt);
+#else
+    return seal(plain, keyHex, {}, salt);
+#endif
+}
+
+std::string encrypt_deterministic(std::string_view plain, const std::string &keyHex, const std::string &salt) {
+    // a separate key for nonces, so they reveal nothing about digest() MACs under keyHex
+    auto nonceKey = digest("vault synthetic nonce key", keyHex);
+    SecureString material(salt.begin(), salt.end());
+    material.push_back('\0');
+    material += plain;
+    auto mac = hex_to_bytes(digest(material, nonceKey));
+    secure_wipe(nonceKey);
+    return seal(plain, keyHex, std::vector<std::uint8_t>(mac.begin(), mac.begin() + 12), salt);
+}
 
-std::string decrypt(const std::string &cipherB64, const std::string &keyHex, const std::string &salt) {
+SecureString decrypt(const std::string &cipherB64, const std::string &keyHex, const std::string &salt) {
     auto keyBytes = hex_to_bytes(keyHex);
     auto packed = base64_decode(cipherB64);
     const std::size_t ivLen = 12;
@@ -214,7 +294,7 @@ std::string decrypt(const std::string &cipherB64, const std::string &keyHex, con
     ULONG outSize = 0;
     status = BCryptDecrypt(key, (PUCHAR)body.data(), (ULONG)body.size(), &gcmInfo, nullptr, 0, nullptr, 0, &outSize, 0);
     if (status < 0) { BCryptDestroyKey(key); BCryptCloseAlgorithmProvider(alg,0); throw std::runtime_error("Decrypt size failed"); }
-    std::string plain(outSize, '\0');
+    SecureString plain(outSize, '\0');
     status = BCryptDecrypt(key, (PUCHAR)body.data(), (ULONG)body.size(), &gcmInfo, nullptr, 0, (PUCHAR)plain.data(), outSize, &outSize, 0);
     if (status < 0) { BCryptDestroyKey(key); BCryptCloseAlgorithmProvider(alg,0); throw std::runtime_error("Decrypt failed"); }
     plain.resize(outSize);
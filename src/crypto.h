@@ -1,10 +1,38 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+
+#include "secure_memory.h"
 
 namespace crypto {
 std::string random_key_hex(std::size_t bytes = 32);
-std::string digest(const std::string &material, const std::string &keyHex = "");
-std::string encrypt(const std::string &plain, const std::string &keyHex, const std::string &salt);
-std::string decrypt(const std::string &cipherB64, const std::string &keyHex, const std::string &salt);
+std::string digest(std::string_view material, const std::string &keyHex = "");
+std::string encrypt(std::string_view plain, const std::string &keyHex, const std::string &salt);
+// Same AES-GCM format as encrypt(), with a synthetic nonce instead of a random one: the first
+// 12 bytes of an HMAC, under a key derived from keyHex, over salt and plaintext. Identical
+// (salt, plain) pairs seal to identical bytes; anything else still gets a distinct nonce, so
+// the key is never reused across different messages. decrypt() reads both.
+std::string encrypt_deterministic(std::string_view plain, const std::string &keyHex, const std::string &salt);
+// The plaintext is allocated from the current SecureArena (or the wiping heap) and wiped when
+// freed; copy it into a std::string only where it leaves the process.
+SecureString decrypt(const std::string &cipherB64, const std::string &keyHex, const std::string &salt);
+
+// Incremental form of digest(): the same HMAC-SHA256 over everything passed to update(),
+// for material too large to assemble in memory first.
+class Hmac {
+  public:
+    explicit Hmac(const std::string &keyHex = "");
+    ~Hmac();
+    Hmac(const Hmac &) = delete;
+    Hmac &operator=(const Hmac &) = delete;
+
+    void update(const std::string &data);
+    // Uppercase hex, as digest() returns. The object cannot be updated afterwards.
+    std::string final();
+
+  private:
+    void *alg_{};
+    void *hash_{};
+};
 }
@@ -0,0 +1,552 @@
+#include "diff.h"
+
+#include "archive.h"
+#include "archive_index.h"
+#include "config.h"
+#include "crypto.h"
+#include "json.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+// Entries fetched per registry per read; the join holds one such page per input.
+constexpr std::size_t kJoinPage = 4096;
+
+// The latest record of every vault in one archive, each registry readable in key order a page
+// at a time. Archives whose header index lists their vaults are read through it, so only the
+// pages in use are held and each is checked against the Merkle tree; anything else (older
+// archives, appended segments) is replayed in full by open_archive.
+class JoinSource {
+  public:
+    struct Vault {
+        std::string name;
+        bool optional{};
+        bool sealed{};
+        std::vector<std::string> registries; // sorted
+    };
+
+    JoinSource(const std::string &path, const VaultConfig &cfg) {
+        auto index = std::make_unique<ArchiveIndex>(path, cfg.token, cfg.masterKey);
+        if (index->usable() && index->lists_vaults()) {
+            std::map<std::string, Vault> byName;
+            for (const auto &v : index->vaults()) byName[v.name] = {v.name, v.optional, v.sealed, {}};
+            for (const auto &r : index->registries()) {
+                auto found = byName.find(r.vault);
+                if (found == byName.end()) throw std::runtime_error("Index lists " + r.vault + "/" + r.registry + " without its vault in " + path);
+                found->second.registries.push_back(r.registry);
+            }
+            for (auto &v : byName) vaults_.push_back(std::move(v.second));
+            dependencies_ = index->dependencies();
+            index_ = std::move(index);
+            return;
+        }
+        loaded_ = open_archive(path, cfg);
+        dependencies_ = loaded_.dependencies;
+        for (const auto &v : loaded_.vaults) latest_[v.name] = &v;
+        for (const auto &entry : latest_) {
+            Vault v{entry.first, entry.second->optional, entry.second->sealed, {}};
+            for (const auto &reg : entry.second->registries) v.registries.push_back(reg.first);
+            std::sort(v.registries.begin(), v.registries.end());
+            vaults_.push_back(std::move(v));
+        }
+    }
+
+    const std::vector<Vault> &vaults() const { return vaults_; }
+    const std::vector<std::string> &dependencies() const { return dependencies_; }
+
+    const Vault *find(const std::string &name) const {
+        auto it = std::lower_bound(vaults_.begin(), vaults_.end(), name, [](const Vault &v, const std::string &n) { return v.name < n; });
+        return it != vaults_.end() && it->name == name ? &*it : nullptr;
+    }
+
+    // Up to kJoinPage entries of vault/registry after `after`, in key order.
+    std::vector<IndexedEntry> page(const std::string &vault, const std::string &registry, const std::optional<std::string> &after) {
+        if (index_) return index_->scan(vault, registry, KeyRange::all(), after, kJoinPage);
+        const auto &entries = latest_.at(vault)->registries.at(registry)->entries;
+        if (sortedFor_ != std::make_pair(vault, registry)) {
+            sortedFor_ = {vault, registry};
+            sortedKeys_.clear();
+            for (const auto &e : entries) sortedKeys_.push_back(e.first);
+            std::sort(sortedKeys_.begin(), sortedKeys_.end());
+        }
+        auto it = after ? std::upper_bound(sortedKeys_.begin(), sortedKeys_.end(), *after) : sortedKeys_.begin();
+        std::vector<IndexedEntry> out;
+        for (; it != sortedKeys_.end() && out.size() < kJoinPage; ++it) {
+            const auto &e = entries.at(*it);
+            out.push_back({*it, e.digest, e.cipher});
+        }
+        return out;
+    }
+
+  private:
+    std::unique_ptr<ArchiveIndex> index_;
+    LoadedArchive loaded_;
+    std::map<std::string, const SealedVault *> latest_;
+    std::vector<Vault> vaults_;
+    std::vector<std::string> dependencies_;
+    std::pair<std::string, std::string> sortedFor_;
+    std::vector<std::string> sortedKeys_;
+};
+
+// One registry of one input, walked in key order; default-constructed for a registry the
+// input does not have.
+class EntryCursor {
+  public:
+    EntryCursor() = default;
+    EntryCursor(JoinSource &source, const std::string &vault, const std::string &registry)
+        : source_(&source), vault_(vault), registry_(registry) {
+        fill();
+    }
+
+    const IndexedEntry *peek() const { return pos_ < buffer_.size() ? &buffer_[pos_] : nullptr; }
+    void next() {
+        if (++pos_ == buffer_.size()) fill();
+    }
+
+  private:
+    void fill() {
+        if (!source_) return;
+        std::optional<std::string> after;
+        if (!buffer_.empty()) after = buffer_.back().key;
+        buffer_ = source_->page(vault_, registry_, after);
+        pos_ = 0;
+    }
+
+    JoinSource *source_{};
+    std::string vault_;
+    std::string registry_;
+    std::vector<IndexedEntry> buffer_;
+    std::size_t pos_{};
+};
+
+EntryCursor open_cursor(JoinSource *source, const JoinSource::Vault *vault, const std::string &registry) {
+    if (!source || !vault || !std::binary_search(vault->registries.begin(), vault->registries.end(), registry)) return {};
+    return EntryCursor(*source, vault->name, registry);
+}
+
+// Calls fn(key, row) for every key present in any cursor, in order; row[i] is cursor i's entry
+// for that key or null.
+template <typename Fn>
+void join_entries(std::vector<EntryCursor> &cursors, Fn fn) {
+    std::vector<const IndexedEntry *> row(cursors.size());
+    for (;;) {
+        const std::string *least = nullptr;
+        for (const auto &c : cursors) {
+            auto e = c.peek();
+            if (e && (!least || e->key < *least)) least = &e->key;
+        }
+        if (!least) return;
+        auto key = *least;
+        for (std::size_t i = 0; i < cursors.size(); ++i) {
+            auto e = cursors[i].peek();
+            row[i] = e && e->key == key ? e : nullptr;
+        }
+        fn(key, row);
+        for (std::size_t i = 0; i < cursors.size(); ++i) {
+            if (row[i]) cursors[i].next();
+        }
+    }
+}
+
+std::vector<std::string> vault_names(std::initializer_list<const JoinSource *> sources) {
+    std::vector<std::string> names;
+    for (auto s : sources) {
+        for (const auto &v : s->vaults()) names.push_back(v.name);
+    }
+    return sorted_unique(std::move(names));
+}
+
+std::vector<std::string> registry_names(std::initializer_list<const JoinSource::Vault *> vaults) {
+    std::vector<std::string> names;
+    for (auto v : vaults) {
+        if (v) names.insert(names.end(), v->registries.begin(), v->registries.end());
+    }
+    return sorted_unique(std::move(names));
+}
+
+SecureString value_of(const IndexedEntry &e, bool sealed, const std::string &registry, const std::string &masterKeyHex) {
+    return sealed ? crypto::decrypt(e.cipher, masterKeyHex, registry + ":" + e.key) : SecureString(e.cipher.begin(), e.cipher.end());
+}
+
+std::string vault_flags(const JoinSource::Vault &v) {
+    return std::string(v.optional ? "optional" : "required") + " " + (v.sealed ? "sealed" : "open");
+}
+
+// Buffered report lines, text or ndjson. The buffer is a SecureString on the wiping heap, so
+// the blocks it outgrows while holding --decrypt plaintexts are wiped as they are freed.
+class Report {
+  public:
+    explicit Report(bool ndjson) : ndjson_(ndjson) {}
+    ~Report() { flush(); }
+
+    bool ndjson() const { return ndjson_; }
+
+    // One line about an entry; values (already decrypted) are named in `values`, e.g.
+    // {"old", ...}, and shown only when given.
+    void entry(const std::string &op, char mark, const std::string &vault, const std::string &registry, const std::string &key,
+               const std::vector<std::pair<std::string, std::optional<SecureString>>> &values) {
+        if (ndjson_) {
+            out_ += "{\"op\":\"" + op + "\",\"vault\":";
+            append_json_quoted(out_, vault);
+            out_ += ",\"registry\":";
+            append_json_quoted(out_, registry);
+            out_ += ",\"key\":";
+            append_json_quoted(out_, key);
+            for (const auto &v : values) {
+                out_ += ",\"" + v.first + "\":";
+                if (v.second) append_json_quoted(out_, *v.second);
+                else out_ += "null";
+            }
+            out_ += "}\n";
+        } else {
+            out_ += std::string(1, mark) + " " + vault + "/" + registry + " " + key;
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                out_ += i ? ", " : ": ";
+                out_ += values[i].first + " ";
+                if (values[i].second) {
+                    out_ += '"';
+                    out_ += *values[i].second;
+                    out_ += '"';
+                } else {
+                    out_ += '-';
+                }
+            }
+            out_ += "\n";
+        }
+        maybe_flush();
+    }
+
+    void vault(const std::string &op, char mark, const std::string &name, const std::string &detail = "") {
+        if (ndjson_) {
+            out_ += "{\"op\":\"" + op + "\",\"vault\":";
+            append_json_quoted(out_, name);
+            if (!detail.empty()) {
+                out_ += ",\"detail\":";
+                append_json_quoted(out_, detail);
+            }
+            out_ += "}\n";
+        } else {
+            out_ += std::string(1, mark) + " vault " + name + (detail.empty() ? "" : ": " + detail) + "\n";
+        }
+        maybe_flush();
+    }
+
+    // Closing line: `# a 1, b 2` or {"a":1,"b":2}.
+    void summary(const std::vector<std::pair<std::string, std::size_t>> &counts) {
+        if (ndjson_) {
+            out_ += "{";
+            for (std::size_t i = 0; i < counts.size(); ++i) out_ += (i ? ",\"" : "\"") + counts[i].first + "\":" + std::to_string(counts[i].second);
+            out_ += "}\n";
+        } else {
+            out_ += "#";
+            for (std::size_t i = 0; i < counts.size(); ++i) out_ += (i ? ", " : " ") + std::to_string(counts[i].second) + " " + counts[i].first;
+            out_ += "\n";
+        }
+        flush();
+    }
+
+    void flush() {
+        std::cout.write(out_.data(), static_cast<std::streamsize>(out_.size()));
+        std::cout.flush();
+        // may hold --decrypt plaintexts
+        if (!out_.empty()) secure_zero(&out_[0], out_.size());
+        out_.clear();
+    }
+
+  private:
+    void maybe_flush() {
+        if (out_.size() >= (1u << 20)) flush();
+    }
+
+    bool ndjson_;
+    SecureString out_;
+};
+
+bool parse_output(const std::string &format, bool &ndjson) {
+    if (format != "text" && format != "ndjson") return false;
+    ndjson = format == "ndjson";
+    return true;
+}
+
+struct DiffOptions {
+    std::string left;
+    std::string right;
+    std::optional<std::string> vault;
+    std::optional<std::string> registry;
+    bool decrypt{false};
+    bool ndjson{false};
+};
+
+void diff_usage() {
+    std::cerr << "Usage: vaultc diff <old.svau> <new.svau> [--vault v] [--registry r] [--decrypt] [--output text|ndjson]\n";
+    std::cerr << "Exit status: 0 when the archives match, 1 when they differ, 2 on error.\n";
+}
+
+// Entries are compared by digest, which covers the stored cipher: a value that was re-sealed
+// shows as changed unless --decrypt compares the plaintexts.
+int run_diff(const DiffOptions &opts, const VaultConfig &cfg) {
+    JoinSource left(opts.left, cfg);
+    JoinSource right(opts.right, cfg);
+    Report report(opts.ndjson);
+    std::size_t added = 0, removed = 0, changed = 0;
+    auto &arena = SecureArena::for_thread();
+
+    for (const auto &name : vault_names({&left, &right})) {
+        if (opts.vault && name != *opts.vault) continue;
+        auto a = left.find(name);
+        auto b = right.find(name);
+        if (!opts.registry) {
+            if (!a) report.vault("added", '+', name, vault_flags(*b));
+            else if (!b) report.vault("removed", '-', name, vault_flags(*a));
+            else if (a->optional != b->optional || a->sealed != b->sealed) report.vault("changed", '~', name, vault_flags(*a) + " -> " + vault_flags(*b));
+        }
+        for (const auto &reg : registry_names({a, b})) {
+            if (opts.registry && reg != *opts.registry) continue;
+            std::vector<EntryCursor> cursors;
+            cursors.push_back(open_cursor(&left, a, reg));
+            cursors.push_back(open_cursor(&right, b, reg));
+            join_entries(cursors, [&](const std::string &key, const std::vector<const IndexedEntry *> &row) {
+                // plaintexts of this entry live in the arena and are wiped once it is reported
+                SecureArena::Scope scope(arena);
+                auto oldValue = [&]() { return value_of(*row[0], a->sealed, reg, cfg.masterKey); };
+                auto newValue = [&]() { return value_of(*row[1], b->sealed, reg, cfg.masterKey); };
+                if (!row[0]) {
+                    added++;
+                    if (opts.decrypt) report.entry("added", '+', name, reg, key, {{"new", newValue()}});
+                    else report.entry("added", '+', name, reg, key, {});
+                } else if (!row[1]) {
+                    removed++;
+                    if (opts.decrypt) report.entry("removed", '-', name, reg, key, {{"old", oldValue()}});
+                    else report.entry("removed", '-', name, reg, key, {});
+                } else if (row[0]->digest != row[1]->digest) {
+                    if (!opts.decrypt) {
+                        changed++;
+                        report.entry("changed", '~', name, reg, key, {});
+                        return;
+                    }
+                    auto was = oldValue();
+                    auto now = newValue();
+                    if (was == now) return;
+                    changed++;
+                    report.entry("changed", '~', name, reg, key, {{"old", was}, {"new", now}});
+                }
+            });
+        }
+    }
+    report.summary({{"added", added}, {"removed", removed}, {"changed", changed}});
+    return added + removed + changed ? 1 : 0;
+}
+
+enum class Prefer { None, Ours, Theirs };
+
+struct MergeOptions {
+    std::string ours;
+    std::string theirs;
+    std::optional<std::string> base;
+    std::string out;
+    Prefer prefer{Prefer::None};
+    bool decrypt{false};
+    bool ndjson{false};
+};
+
+void merge_usage() {
+    std::cerr << "Usage: vaultc merge <ours.svau> <theirs.svau> --out merged.svau [--base base.svau] [--prefer ours|theirs] [--decrypt] [--output text|ndjson]\n";
+    std::cerr << "Without --base, keys from either side are kept and differing values conflict. Conflicts are listed and,\n"
+                 "unless --prefer resolves them, nothing is written (exit status 1).\n";
+}
+
+// A vault or registry one side dropped since the base disappears unless the merge still puts
+// entries in it; one that only exists on one side otherwise (e.g. both sides lack a base) is
+// kept even when empty.
+bool keep_container(bool inOurs, bool inTheirs, bool inBase, bool empty) {
+    if (inOurs && inTheirs) return true;
+    if (!inBase) return inOurs || inTheirs;
+    return !empty;
+}
+
+int run_merge(const MergeOptions &opts, const VaultConfig &cfg) {
+    std::size_t written = 0, fromTheirs = 0, conflicts = 0;
+    Report report(opts.ndjson);
+    std::vector<std::string> deps;
+    std::unique_ptr<StreamedArchiveWriter> output;
+    auto &arena = SecureArena::for_thread();
+    {
+        JoinSource ours(opts.ours, cfg);
+        JoinSource theirs(opts.theirs, cfg);
+        std::optional<JoinSource> base;
+        if (opts.base) base.emplace(*opts.base, cfg);
+        deps = ours.dependencies();
+        deps.insert(deps.end(), theirs.dependencies().begin(), theirs.dependencies().end());
+        output = std::make_unique<StreamedArchiveWriter>(opts.out, cfg.token, cfg.masterKey, deps);
+        auto &records = output->records();
+
+        for (const auto &name : vault_names({&ours, &theirs})) {
+            auto o = ours.find(name);
+            auto t = theirs.find(name);
+            auto b = base ? base->find(name) : nullptr;
+            if (o && t && o->sealed != t->sealed) {
+                throw std::runtime_error("Vault " + name + " is sealed in one archive and open in the other; merge it by hand");
+            }
+            bool sealed = o ? o->sealed : t->sealed;
+            bool optional = o ? o->optional : t->optional;
+            if (o && t && o->optional != t->optional) {
+                if (b && b->optional == o->optional) {
+                    optional = t->optional;
+                } else if (!b || b->optional != t->optional) {
+                    conflicts++;
+                    report.vault("conflict", '!', name, "ours " + vault_flags(*o) + ", theirs " + vault_flags(*t));
+                    if (opts.prefer == Prefer::Theirs) optional = t->optional;
+                }
+            }
+
+            bool vaultBegun = false;
+            auto beginVault = [&]() {
+                if (!vaultBegun) records.begin_vault(name, optional, sealed);
+                vaultBegun = true;
+            };
+            for (const auto &reg : registry_names({o, t})) {
+                auto has = [&](const JoinSource::Vault *v) { return v && std::binary_search(v->registries.begin(), v->registries.end(), reg); };
+                bool registryBegun = false;
+                auto beginRegistry = [&]() {
+                    beginVault();
+                    if (!registryBegun) records.begin_registry(reg);
+                    registryBegun = true;
+                };
+                std::vector<EntryCursor> cursors;
+                cursors.push_back(open_cursor(&ours, o, reg));
+                cursors.push_back(open_cursor(&theirs, t, reg));
+                cursors.push_back(open_cursor(base ? &*base : nullptr, b, reg));
+                join_entries(cursors, [&](const std::string &key, const std::vector<const IndexedEntry *> &row) {
+                    SecureArena::Scope scope(arena);
+                    bool sealedOf[3] = {o && o->sealed, t && t->sealed, b && b->sealed};
+                    auto value = [&](int i) -> std::optional<SecureString> {
+                        if (!row[i]) return std::nullopt;
+                        return value_of(*row[i], sealedOf[i], reg, cfg.masterKey);
+                    };
+                    auto same = [&](int i, int j) {
+                        if (!row[i] || !row[j]) return !row[i] && !row[j];
+                        if (row[i]->digest == row[j]->digest) return true;
+                        return opts.decrypt && value(i) == value(j);
+                    };
+                    const IndexedEntry *chosen = nullptr;
+                    if (same(0, 1)) {
+                        chosen = row[0];
+                    } else if (base && same(0, 2)) {
+                        chosen = row[1];
+                    } else if (base && same(1, 2)) {
+                        chosen = row[0];
+                    } else if (!base && (!row[0] || !row[1])) {
+                        chosen = row[0] ? row[0] : row[1];
+                    } else {
+                        conflicts++;
+                        if (opts.decrypt) report.entry("conflict", '!', name, reg, key, {{"ours", value(0)}, {"theirs", value(1)}});
+                        else report.entry("conflict", '!', name, reg, key, {});
+                        if (opts.prefer == Prefer::None) return;
+                        chosen = opts.prefer == Prefer::Ours ? row[0] : row[1];
+                    }
+                    if (!chosen) return;
+                    beginRegistry();
+                    records.entry(key, chosen->digest, chosen->cipher);
+                    written++;
+                    if (chosen == row[1] && !same(0, 1)) fromTheirs++;
+                });
+                if (!registryBegun && keep_container(has(o), has(t), has(b), true)) beginRegistry();
+            }
+            if (!vaultBegun && keep_container(o, t, b, true)) beginVault();
+            if (vaultBegun) records.end_vault();
+        }
+    }
+    report.summary({{"entries", written}, {"from theirs", fromTheirs}, {"conflicts", conflicts}});
+    if (conflicts && opts.prefer == Prefer::None) {
+        std::cerr << "Not written: " << conflicts << " conflict(s); resolve them or pass --prefer ours|theirs\n";
+        return 1;
+    }
+    output->commit();
+    return 0;
+}
+}
+
+int diff_main(int argc, char **argv) {
+    DiffOptions opts;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vault" && i + 1 < argc) {
+            opts.vault = std::string(argv[++i]);
+        } else if (arg == "--registry" && i + 1 < argc) {
+            opts.registry = std::string(argv[++i]);
+        } else if (arg == "--decrypt") {
+            opts.decrypt = true;
+        } else if (arg == "--output" && i + 1 < argc && parse_output(argv[i + 1], opts.ndjson)) {
+            ++i;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            diff_usage();
+            return 2;
+        }
+    }
+    if (paths.size() != 2) {
+        diff_usage();
+        return 2;
+    }
+    opts.left = paths[0];
+    opts.right = paths[1];
+    try {
+        return run_diff(opts, load_config(false));
+    } catch (const std::exception &ex) {
+        std::cout.flush();
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 2;
+    }
+}
+
+int merge_main(int argc, char **argv) {
+    MergeOptions opts;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--base" && i + 1 < argc) {
+            opts.base = std::string(argv[++i]);
+        } else if ((arg == "--out" || arg == "-o") && i + 1 < argc) {
+            opts.out = argv[++i];
+        } else if (arg == "--prefer" && i + 1 < argc) {
+            std::string side = argv[++i];
+            if (side != "ours" && side != "theirs") {
+                merge_usage();
+                return 2;
+            }
+            opts.prefer = side == "ours" ? Prefer::Ours : Prefer::Theirs;
+        } else if (arg == "--decrypt") {
+            opts.decrypt = true;
+        } else if (arg == "--output" && i + 1 < argc && parse_output(argv[i + 1], opts.ndjson)) {
+            ++i;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            merge_usage();
+            return 2;
+        }
+    }
+    if (paths.size() != 2 || opts.out.empty()) {
+        merge_usage();
+        return 2;
+    }
+    opts.ours = paths[0];
+    opts.theirs = paths[1];
+    try {
+        return run_merge(opts, load_config(false));
+    } catch (const std::exception &ex) {
+        std::cout.flush();
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 2;
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// `vaultc diff` and `vaultc merge`: merge-joins over archives' sorted registries that compare
+// entry digests instead of decrypting. argv[0] is "diff" or "merge".
+int diff_main(int argc, char **argv);
+int merge_main(int argc, char **argv);
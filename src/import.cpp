@@ -0,0 +1,477 @@
+#include "import.h"
+
+#include "archive.h"
+#include "config.h"
+#include "crypto.h"
+#include "json.h"
+#include "parallel.h"
+#include "secure_memory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+enum class ImportFormat { Ndjson, Csv };
+
+struct ImportOptions {
+    std::vector<std::string> inputs;
+    std::string vault;
+    std::string registry;
+    std::string output;
+    std::optional<std::string> loadPath;
+    std::optional<ImportFormat> format;
+    bool replace{false};
+    bool deterministic{false};
+    bool verbose{false};
+    unsigned jobs{default_jobs()};
+    std::size_t batch{65536};
+};
+
+void import_usage() {
+    std::cerr << "Usage: vaultc import <data.ndjson|data.csv|-> [...] --vault v --registry r --out file.svau [--load file.svau] [--replace] [--format ndjson|csv] [--jobs n] [--batch n] [--deterministic] [--verbose]\n";
+}
+
+bool parse_format(const std::string &name, ImportFormat &out) {
+    if (name == "ndjson") out = ImportFormat::Ndjson;
+    else if (name == "csv") out = ImportFormat::Csv;
+    else return false;
+    return true;
+}
+
+ImportFormat format_of(const std::string &path, const ImportOptions &opts) {
+    if (opts.format) return *opts.format;
+    auto ext = std::filesystem::path(path).extension().string();
+    if (ext == ".csv") return ImportFormat::Csv;
+    if (ext == ".ndjson" || ext == ".jsonl" || ext == ".json") return ImportFormat::Ndjson;
+    throw std::runtime_error("Cannot tell the format of " + path + "; pass --format ndjson|csv");
+}
+
+// Wipes every string a parsed document holds, object member names included.
+void wipe_json(JsonValue &v) {
+    secure_wipe(v.string);
+    for (auto &item : v.array) wipe_json(item);
+    for (auto &member : v.object) {
+        secure_wipe(member.first);
+        wipe_json(member.second);
+    }
+}
+
+// Wipes the parsed line on every way out of next_ndjson.
+struct DocumentWipe {
+    JsonValue &doc;
+    ~DocumentWipe() { wipe_json(doc); }
+};
+
+// Key/value pairs from NDJSON objects ({"key": ..., "value": ...}; a value that is not a string
+// is stored as its JSON text) or from two-column CSV (RFC 4180 quoting; a leading `key,value`
+// header row is skipped). "-" reads standard input.
+class RecordReader {
+  public:
+    RecordReader(const std::string &path, ImportFormat format)
+        : path_(path), format_(format), fields_(FieldAllocator(nullptr)) {
+        if (path == "-") {
+            in_ = &std::cin;
+            return;
+        }
+        file_.open(path, std::ios::binary);
+        if (!file_) throw std::runtime_error("Unable to read: " + path);
+        in_ = &file_;
+    }
+
+    bool next(std::string &key, std::string &value) {
+        return format_ == ImportFormat::Csv ? next_csv(key, value) : next_ndjson(key, value);
+    }
+
+  private:
+    bool next_ndjson(std::string &key, std::string &value) {
+        while (std::getline(*in_, line_)) {
+            lineNo_++;
+            if (!line_.empty() && line_.back() == '\r') line_.pop_back();
+            if (line_.find_first_not_of(" \t") == std::string::npos) continue;
+            JsonValue doc;
+            DocumentWipe wipe{doc};
+            try {
+                doc = parse_json(line_);
+            } catch (const std::exception &ex) {
+                throw std::runtime_error(where() + ": " + ex.what());
+            }
+            const auto &k = doc["key"];
+            const auto &v = doc["value"];
+            if (k.type != JsonValue::Type::String) throw std::runtime_error(where() + ": expected a string \"key\"");
+            if (v.is_null()) throw std::runtime_error(where() + ": missing \"value\"");
+            key = k.string;
+            if (v.type == JsonValue::Type::String) {
+                value = v.string;
+            } else {
+                SecureString text{SecureAllocator<char>(nullptr)};
+                append_json(text, v);
+                value.assign(text.data(), text.size());
+            }
+            secure_wipe(line_);
+            return true;
+        }
+        return false;
+    }
+
+    bool next_csv(std::string &key, std::string &value) {
+        while (read_fields()) {
+            if (fields_.size() == 1 && fields_[0].empty()) continue; // blank line
+            if (fields_.size() != 2) throw std::runtime_error(where() + ": expected 2 columns, found " + std::to_string(fields_.size()));
+            bool header = lineNo_ == 1 && fields_[0] == "key" && fields_[1] == "value";
+            if (header) continue;
+            key.assign(fields_[0].data(), fields_[0].size());
+            value.assign(fields_[1].data(), fields_[1].size());
+            return true;
+        }
+        return false;
+    }
+
+    // One CSV record; quoted fields may hold commas, doubled quotes and line breaks. Fields
+    // grow on the wiping heap, so a reallocation leaves no plaintext behind.
+    bool read_fields() {
+        fields_.clear();
+        SecureString field{SecureAllocator<char>(nullptr)};
+        bool quoted = false;
+        bool any = false;
+        lineNo_++;
+        int c;
+        while ((c = in_->get()) != EOF) {
+            any = true;
+            if (quoted) {
+                if (c == '"') {
+                    if (in_->peek() == '"') {
+                        in_->get();
+                        field.push_back('"');
+                    } else {
+                        quoted = false;
+                    }
+                } else {
+                    field.push_back(static_cast<char>(c));
+                }
+            } else if (c == '"') {
+                quoted = true;
+            } else if (c == ',') {
+                fields_.push_back(std::move(field));
+                field.clear();
+            } else if (c == '\n') {
+                break;
+            } else if (c != '\r') {
+                field.push_back(static_cast<char>(c));
+            }
+        }
+        if (!any) return false;
+        if (quoted) throw std::runtime_error(where() + ": unterminated quoted field");
+        fields_.push_back(std::move(field));
+        return true;
+    }
+
+    std::string where() const { return path_ + ":" + std::to_string(lineNo_); }
+
+    std::string path_;
+    ImportFormat format_;
+    std::ifstream file_;
+    std::istream *in_{};
+    std::string line_;
+    using FieldAllocator = SecureAllocator<SecureString>;
+    std::vector<SecureString, FieldAllocator> fields_;
+    std::uint64_t lineNo_{};
+};
+
+// One input record; `seq` is its position across all inputs, so under --replace the later of
+// two records with the same key wins.
+struct ImportRecord {
+    std::string key;
+    std::string value;
+    SealedEntry sealed;
+    std::uint64_t seq{};
+};
+
+bool record_before(const ImportRecord &a, const ImportRecord &b) {
+    return a.key != b.key ? a.key < b.key : a.seq < b.seq;
+}
+
+// Sealed, sorted chunks spilled next to the output: key, digest, cipher and seq lines per
+// entry. They hold ciphers only; plaintexts are wiped once sealed.
+struct RunFiles {
+    std::vector<std::string> paths;
+    ~RunFiles() {
+        std::error_code ec;
+        for (const auto &p : paths) std::filesystem::remove(p, ec);
+    }
+};
+
+class RunReader {
+  public:
+    explicit RunReader(const std::string &path) : in_(path, std::ios::binary) {
+        if (!in_) throw std::runtime_error("Unable to read: " + path);
+    }
+
+    bool advance() {
+        std::string seq;
+        if (!std::getline(in_, current.key)) return false;
+        if (!std::getline(in_, current.sealed.digest) || !std::getline(in_, current.sealed.cipher) || !std::getline(in_, seq)) {
+            throw std::runtime_error("Truncated import run");
+        }
+        current.seq = std::stoull(seq);
+        return true;
+    }
+
+    ImportRecord current;
+
+  private:
+    std::ifstream in_;
+};
+
+// K-way merge of the runs in key order. Equal keys are an error unless `replace`, which keeps
+// the latest record.
+class RunMerge {
+  public:
+    RunMerge(const std::vector<std::string> &paths, bool replace) : replace_(replace) {
+        for (const auto &p : paths) {
+            readers_.push_back(std::make_unique<RunReader>(p));
+            if (readers_.back()->advance()) heap_.push(readers_.size() - 1);
+        }
+    }
+
+    const ImportRecord *next() {
+        if (heap_.empty()) return nullptr;
+        take(current_);
+        while (!heap_.empty() && readers_[heap_.top()]->current.key == current_.key) {
+            if (!replace_) throw std::runtime_error("Duplicate key in import: " + current_.key + " (pass --replace to keep the last)");
+            take(current_);
+        }
+        return &current_;
+    }
+
+  private:
+    void take(ImportRecord &into) {
+        auto i = heap_.top();
+        heap_.pop();
+        into = std::move(readers_[i]->current);
+        if (readers_[i]->advance()) heap_.push(i);
+    }
+
+    struct Later {
+        const std::vector<std::unique_ptr<RunReader>> *readers;
+        bool operator()(std::size_t a, std::size_t b) const { return record_before((*readers)[b]->current, (*readers)[a]->current); }
+    };
+
+    bool replace_;
+    std::vector<std::unique_ptr<RunReader>> readers_;
+    std::priority_queue<std::size_t, std::vector<std::size_t>, Later> heap_{Later{&readers_}};
+    ImportRecord current_;
+};
+
+struct ImportStats {
+    std::uint64_t records{};
+    std::uint64_t written{};
+    std::uint64_t replaced{};
+};
+
+// Seals a chunk on the worker threads, sorts it and writes it out as a run.
+void spill_chunk(std::vector<ImportRecord> &chunk, const ImportOptions &opts, const std::string &masterKey, RunFiles &runs) {
+    parallel_for(chunk.size(), opts.jobs, [&](std::size_t i) {
+        auto &r = chunk[i];
+        auto salt = opts.registry + ":" + r.key;
+        r.sealed.cipher = opts.deterministic ? crypto::encrypt_deterministic(r.value, masterKey, salt) : crypto::encrypt(r.value, masterKey, salt);
+        r.sealed.digest = crypto::digest(r.sealed.cipher, masterKey);
+        secure_wipe(r.value);
+    });
+    std::sort(chunk.begin(), chunk.end(), record_before);
+    auto path = opts.output + ".run-" + std::to_string(runs.paths.size()) + ".tmp";
+    runs.paths.push_back(path);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Unable to write: " + path);
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+        const auto &r = chunk[i];
+        if (i + 1 < chunk.size() && chunk[i + 1].key == r.key) {
+            if (!opts.replace) throw std::runtime_error("Duplicate key in import: " + r.key + " (pass --replace to keep the last)");
+            continue;
+        }
+        out << r.key << "\n" << r.sealed.digest << "\n" << r.sealed.cipher << "\n" << r.seq << "\n";
+    }
+    if (!out.flush()) throw std::runtime_error("Write failed: " + path);
+    chunk.clear();
+}
+
+// The import registry merged, in key order, with the seed's entries for it.
+void write_import_registry(RecordWriter &writer, const SealedRegistry *seed, RunMerge &merge, const ImportOptions &opts, ImportStats &stats) {
+    std::vector<std::string> seedKeys;
+    if (seed) {
+        seedKeys.reserve(seed->entries.size());
+        for (const auto &e : seed->entries) seedKeys.push_back(e.first);
+        std::sort(seedKeys.begin(), seedKeys.end());
+    }
+    auto s = seedKeys.begin();
+    const ImportRecord *r = merge.next();
+    while (s != seedKeys.end() || r) {
+        if (!r || (s != seedKeys.end() && *s < r->key)) {
+            const auto &entry = seed->entries.at(*s);
+            writer.entry(*s, entry.digest, entry.cipher);
+            ++s;
+            continue;
+        }
+        if (s != seedKeys.end() && *s == r->key) {
+            if (!opts.replace) {
+                throw std::runtime_error("Key " + r->key + " already exists in " + opts.vault + "/" + opts.registry + " (pass --replace to overwrite)");
+            }
+            stats.replaced++;
+            ++s;
+        }
+        writer.entry(r->key, r->sealed.digest, r->sealed.cipher);
+        stats.written++;
+        r = merge.next();
+    }
+}
+
+// The target vault's record with the import registry merged in; `seed` is its latest record in
+// the --load archive, or a fresh required, sealed vault.
+void write_import_vault(RecordWriter &writer, const SealedVault &seed, RunMerge &merge, const ImportOptions &opts, ImportStats &stats) {
+    writer.begin_vault(seed.name, seed.optional, seed.sealed);
+    std::vector<std::string> registryNames{opts.registry};
+    for (const auto &regPair : seed.registries) registryNames.push_back(regPair.first);
+    for (const auto &regName : sorted_unique(std::move(registryNames))) {
+        writer.begin_registry(regName);
+        auto found = seed.registries.find(regName);
+        const SealedRegistry *reg = found == seed.registries.end() ? nullptr : &*found->second;
+        if (regName == opts.registry) {
+            write_import_registry(writer, reg, merge, opts, stats);
+            continue;
+        }
+        std::vector<std::string> keys;
+        for (const auto &e : reg->entries) keys.push_back(e.first);
+        std::sort(keys.begin(), keys.end());
+        for (const auto &k : keys) writer.entry(k, reg->entries.at(k).digest, reg->entries.at(k).cipher);
+    }
+    writer.end_vault();
+}
+
+bool valid_name(const std::string &name) {
+    return !name.empty() && name.find_first_of(" \t\r\n") == std::string::npos;
+}
+}
+
+int import_main(int argc, char **argv) {
+    ImportOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vault" && i + 1 < argc) {
+            opts.vault = argv[++i];
+        } else if (arg == "--registry" && i + 1 < argc) {
+            opts.registry = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            opts.output = argv[++i];
+        } else if (arg == "--load" && i + 1 < argc) {
+            opts.loadPath = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            ImportFormat format;
+            if (!parse_format(argv[++i], format)) {
+                import_usage();
+                return 1;
+            }
+            opts.format = format;
+        } else if (arg == "--replace") {
+            opts.replace = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--batch" && i + 1 < argc) {
+            opts.batch = static_cast<std::size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--deterministic") {
+            opts.deterministic = true;
+        } else if (arg == "--verbose") {
+            opts.verbose = true;
+        } else if (arg == "-" || (!arg.empty() && arg[0] != '-')) {
+            opts.inputs.push_back(arg);
+        } else {
+            import_usage();
+            return 1;
+        }
+    }
+    if (opts.inputs.empty() || opts.output.empty() || opts.vault.empty() || opts.registry.empty()) {
+        import_usage();
+        return 1;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    };
+    try {
+        if (!valid_name(opts.vault) || !valid_name(opts.registry)) throw std::runtime_error("Vault and registry names cannot contain whitespace");
+        auto cfg = load_config(false);
+        LoadedArchive seed;
+        std::vector<std::string> dependencies;
+        if (opts.loadPath) {
+            seed = open_archive(*opts.loadPath, cfg);
+            dependencies = seed.dependencies;
+            dependencies.push_back(std::filesystem::path(*opts.loadPath).filename().string());
+        }
+
+        // read and seal a chunk at a time, spilling each as a sorted run
+        RunFiles runs;
+        ImportStats stats;
+        std::vector<ImportRecord> chunk;
+        chunk.reserve(opts.batch);
+        auto spill = [&]() {
+            if (chunk.empty()) return;
+            spill_chunk(chunk, opts, cfg.masterKey, runs);
+            if (opts.verbose) {
+                auto ms = std::max<long long>(1, elapsedMs());
+                std::cerr << "sealed " << stats.records << " records (" << stats.records * 1000 / ms << "/s)\n";
+            }
+        };
+        for (const auto &input : opts.inputs) {
+            RecordReader reader(input, format_of(input, opts));
+            ImportRecord record;
+            while (reader.next(record.key, record.value)) {
+                if (record.key.empty() || record.key.find_first_of("\r\n") != std::string::npos) {
+                    throw std::runtime_error("Keys must be non-empty and on one line: " + input + " record " + std::to_string(stats.records + 1));
+                }
+                record.seq = stats.records++;
+                chunk.push_back(std::move(record));
+                record = ImportRecord{};
+                if (chunk.size() >= opts.batch) spill();
+            }
+        }
+        spill();
+
+        // merge the runs into the target registry while streaming the rest of the seed through
+        StreamedArchiveWriter output(opts.output, cfg.token, cfg.masterKey, dependencies);
+        auto &writer = output.records();
+        RunMerge merge(runs.paths, opts.replace);
+        auto latest = std::find_if(seed.vaults.rbegin(), seed.vaults.rend(), [&](const SealedVault &v) { return v.name == opts.vault; });
+        for (auto it = seed.vaults.begin(); it != seed.vaults.end(); ++it) {
+            if (latest != seed.vaults.rend() && &*it == &*latest) write_import_vault(writer, *it, merge, opts, stats);
+            else write_vault_record(writer, *it);
+        }
+        if (latest == seed.vaults.rend()) {
+            SealedVault fresh;
+            fresh.name = opts.vault;
+            fresh.sealed = true;
+            write_import_vault(writer, fresh, merge, opts, stats);
+        }
+        auto bytes = output.commit();
+        if (opts.verbose) {
+            std::cout << "imported " << stats.written << " of " << stats.records << " records (" << stats.replaced << " replaced) into "
+                      << opts.vault << "/" << opts.registry << " in " << opts.output << " (" << bytes << " bytes of records, "
+                      << runs.paths.size() << " run(s)) in " << elapsedMs() << " ms\n";
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// `vaultc import`: seals key/value records from NDJSON or CSV straight into one registry of an
+// archive, without generating and interpreting a script. argv[0] is "import".
+int import_main(int argc, char **argv);
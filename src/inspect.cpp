@@ -0,0 +1,205 @@
+#include "inspect.h"
+
+#include "crypto.h"
+#include "json.h"
+
+#include <cstdint>
+#include <string_view>
+
+namespace {
+constexpr std::size_t kFlushBytes = 1 << 20;
+
+// Accumulates output and hands it to the stream in large writes.
+class OutBuffer {
+  public:
+    // on the wiping heap even inside an arena scope: a value larger than the reserve grows the
+    // buffer, and the block it leaves behind must be wiped too
+    explicit OutBuffer(std::ostream &out) : out_(out), buf_(SecureAllocator<char>(nullptr)) { buf_.reserve(kFlushBytes + 4096); }
+    ~OutBuffer() { flush(); }
+
+    SecureString &str() { return buf_; }
+
+    void maybe_flush() {
+        if (buf_.size() >= kFlushBytes) flush();
+    }
+
+    void flush() {
+        if (buf_.empty()) return;
+        out_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+        // the buffer holds plaintexts; wipe them rather than leave them for the next batch
+        secure_zero(&buf_[0], buf_.size());
+        buf_.clear();
+    }
+
+  private:
+    std::ostream &out_;
+    SecureString buf_;
+};
+
+void put_u32(SecureString &out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+void put_field(SecureString &out, std::string_view s) {
+    put_u32(out, static_cast<std::uint32_t>(s.size()));
+    out += s;
+}
+
+template <typename Fn>
+void for_each_entry(const SealedVault &v, const std::string &regName, const SealedRegistry &reg, Fn fn) {
+    for (const auto &entryPair : reg.entries) {
+        const auto &key = entryPair.first;
+        const auto &entry = entryPair.second;
+        if (!v.sealed) {
+            fn(key, std::string_view(entry.cipher), entry.digest);
+            continue;
+        }
+        // the plaintext lives in this thread's arena and is wiped as the scope closes
+        SecureArena::Scope scope(SecureArena::for_thread());
+        auto plain = crypto::decrypt(entry.cipher, v.masterKeyHex, regName + ":" + key);
+        fn(key, std::string_view(plain), entry.digest);
+    }
+}
+
+void write_text(OutBuffer &buf, const LoadedArchive &archive, bool hideMac) {
+    auto &out = buf.str();
+    out += "# Vault Archive (decrypted view)\n";
+    if (!archive.dependencies.empty()) {
+        out += "depends";
+        for (const auto &d : archive.dependencies) out += " " + d;
+        out += "\n";
+    }
+    for (const auto &v : archive.vaults) {
+        out += "vault " + v.name + "\n";
+        for (const auto &regPair : v.registries) {
+            out += "  registry " + regPair.first + "\n";
+            for_each_entry(v, regPair.first, *regPair.second, [&](const std::string &key, std::string_view plain, const std::string &mac) {
+                out += "    " + key + " = \"";
+                out += plain;
+                out += "\"";
+                if (!hideMac && v.sealed) out += " (mac=" + mac + ")";
+                out += "\n";
+                buf.maybe_flush();
+            });
+        }
+        out += "---\n";
+    }
+}
+
+void write_json_document(OutBuffer &buf, const LoadedArchive &archive, bool hideMac) {
+    auto &out = buf.str();
+    out += "{\"depends\":[";
+    for (std::size_t i = 0; i < archive.dependencies.size(); ++i) {
+        if (i) out.push_back(',');
+        append_json_quoted(out, archive.dependencies[i]);
+    }
+    out += "],\"vaults\":[";
+    bool firstVault = true;
+    for (const auto &v : archive.vaults) {
+        if (!firstVault) out.push_back(',');
+        firstVault = false;
+        out += "{\"name\":";
+        append_json_quoted(out, v.name);
+        out += v.sealed ? ",\"sealed\":true" : ",\"sealed\":false";
+        out += ",\"registries\":[";
+        bool firstReg = true;
+        for (const auto &regPair : v.registries) {
+            if (!firstReg) out.push_back(',');
+            firstReg = false;
+            out += "{\"name\":";
+            append_json_quoted(out, regPair.first);
+            out += ",\"entries\":[";
+            bool firstEntry = true;
+            for_each_entry(v, regPair.first, *regPair.second, [&](const std::string &key, std::string_view plain, const std::string &mac) {
+                if (!firstEntry) out.push_back(',');
+                firstEntry = false;
+                out += "{\"key\":";
+                append_json_quoted(out, key);
+                out += ",\"value\":";
+                append_json_quoted(out, plain);
+                if (!hideMac && v.sealed) {
+                    out += ",\"mac\":";
+                    append_json_quoted(out, mac);
+                }
+                out.push_back('}');
+                buf.maybe_flush();
+            });
+            out += "]}";
+        }
+        out += "]}";
+    }
+    out += "]}\n";
+}
+
+void write_ndjson(OutBuffer &buf, const LoadedArchive &archive, bool hideMac) {
+    auto &out = buf.str();
+    for (const auto &v : archive.vaults) {
+        for (const auto &regPair : v.registries) {
+            for_each_entry(v, regPair.first, *regPair.second, [&](const std::string &key, std::string_view plain, const std::string &mac) {
+                out += "{\"vault\":";
+                append_json_quoted(out, v.name);
+                out += ",\"registry\":";
+                append_json_quoted(out, regPair.first);
+                out += ",\"key\":";
+                append_json_quoted(out, key);
+                out += ",\"value\":";
+                append_json_quoted(out, plain);
+                if (!hideMac && v.sealed) {
+                    out += ",\"mac\":";
+                    append_json_quoted(out, mac);
+                }
+                out += "}\n";
+                buf.maybe_flush();
+            });
+        }
+    }
+}
+
+void write_binary(OutBuffer &buf, const LoadedArchive &archive, bool hideMac) {
+    auto &out = buf.str();
+    out += "VAULTBIN";
+    out.push_back('\x01');
+    for (const auto &d : archive.dependencies) {
+        out.push_back('D');
+        put_field(out, d);
+    }
+    for (const auto &v : archive.vaults) {
+        out.push_back('V');
+        put_field(out, v.name);
+        out.push_back(v.sealed ? '\x01' : '\x00');
+        for (const auto &regPair : v.registries) {
+            out.push_back('R');
+            put_field(out, regPair.first);
+            for_each_entry(v, regPair.first, *regPair.second, [&](const std::string &key, std::string_view plain, const std::string &mac) {
+                out.push_back('E');
+                put_field(out, key);
+                put_field(out, plain);
+                put_field(out, !hideMac && v.sealed ? std::string_view(mac) : std::string_view());
+                buf.maybe_flush();
+            });
+        }
+    }
+    out.push_back('Z');
+}
+}
+
+bool parse_inspect_format(const std::string &name, InspectFormat &out) {
+    if (name == "text") out = InspectFormat::Text;
+    else if (name == "json") out = InspectFormat::Json;
+    else if (name == "ndjson") out = InspectFormat::Ndjson;
+    else if (name == "binary") out = InspectFormat::Binary;
+    else return false;
+    return true;
+}
+
+void write_inspect(std::ostream &out, const LoadedArchive &archive, InspectFormat format, bool hideMac) {
+    OutBuffer buf(out);
+    switch (format) {
+    case InspectFormat::Text: write_text(buf, archive, hideMac); break;
+    case InspectFormat::Json: write_json_document(buf, archive, hideMac); break;
+    case InspectFormat::Ndjson: write_ndjson(buf, archive, hideMac); break;
+    case InspectFormat::Binary: write_binary(buf, archive, hideMac); break;
+    }
+    buf.flush();
+    out.flush();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "archive.h"
+
+#include <ostream>
+#include <string>
+
+enum class InspectFormat { Text, Json, Ndjson, Binary };
+
+// Parses the value of `--output`; false for an unknown name.
+bool parse_inspect_format(const std::string &name, InspectFormat &out);
+
+// Decrypted view of an opened archive in the requested format. Output is assembled in one
+// large buffer and handed to `out` in a few big writes rather than per field.
+//   text    the human-readable `vault` / `registry` / `key = "value"` layout
+//   json    one document: {"depends":[...],"vaults":[{"name","sealed","registries":[{"name","entries":[...]}]}]}
+//   ndjson  one object per entry: {"vault","registry","key","value","mac"}
+//   binary  "VAULTBIN" 0x01, then records of a tag byte followed by u32-LE length-prefixed
+//           fields: 'D' dependency, 'V' vault name + sealed byte, 'R' registry, 'E' key,
+//           value, mac; ends with 'Z'
+// mac is omitted (json, ndjson) or empty (binary) for unsealed vaults and with hideMac.
+void write_inspect(std::ostream &out, const LoadedArchive &archive, InspectFormat format, bool hideMac);
@@ -2,8 +2,10 @@
 
 #include "ast.h"
 #include "crypto.h"
+#include "parallel.h"
 
 #include <chrono>
+#include <exception>
 #include <iomanip>
 #include <iostream>
 #include <random>
@@ -15,34 +17,97 @@ Interpreter::Interpreter(InterpreterOptions opts) : opts_(opts) {}
 
 void Interpreter::seed(const std::vector<SealedVault> &existing) {
     byName_.clear();
-    sealed_.clear();
     for (const auto &v : existing) {
         byName_[v.name] = v;
     }
 }
 
 std::vector<SealedVault> Interpreter::run(const std::vector<VaultBlock> &program) {
-    sealed_.clear();
-    for (const auto &vault : program) {
-        evaluate_vault(vault);
-    }
     std::vector<SealedVault> out;
-    out.reserve(sealed_.size());
-    for (auto &v : sealed_) out.push_back(std::move(v));
+    out.reserve(program.size());
+    for (auto &v : evaluate(program)) {
+        if (v) out.push_back(std::move(*v));
+    }
     return out;
 }
 
-void Interpreter::evaluate_vault(const VaultBlock &vault) {
-    currentRegistry_.reset();
-    currentVault_.clear();
-    auto found = byName_.find(vault.name);
-    bool exists = found != byName_.end();
-    if (vault.optional && !exists && !opts_.materializeOptional) {
-        if (opts_.verbose) std::cout << "[skip] optional vault '" << vault.name << "' not present\n";
-        return;
+std::vector<std::optional<SealedVault>> Interpreter::evaluate(const std::vector<VaultBlock> &program) {
+    // One context per distinct vault name, in order of first appearance.
+    std::vector<EvalContext> contexts;
+    std::vector<std::vector<std::size_t>> groups;
+    std::vector<std::size_t> groupOf(program.size());
+    std::unordered_map<std::string, std::size_t> byGroup;
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        auto inserted = byGroup.emplace(program[i].name, groups.size());
+        if (inserted.second) {
+            groups.emplace_back();
+            contexts.emplace_back();
+            auto found = byName_.find(program[i].name);
+            if (found != byName_.end()) contexts.back().vault = std::move(found->second);
+        }
+        groupOf[i] = inserted.first->second;
+        groups[inserted.first->second].push_back(i);
     }
 
-    if (!exists) {
+    std::vector<std::optional<Cow<SealedVault>>> emitted(program.size());
+    auto step = [&](std::size_t i, std::ostream &log) {
+        auto &ctx = contexts[groupOf[i]];
+        ctx.log = &log;
+        if (evaluate_vault(program[i], ctx)) emitted[i] = *ctx.vault;
+    };
+
+    // The vaults were moved out of byName_ so blocks write them without copying; they go back
+    // whether or not a block throws, or a later run would find moved-from handles.
+    auto store = [&] {
+        for (std::size_t g = 0; g < groups.size(); ++g) {
+            if (contexts[g].vault) byName_[program[groups[g].front()].name] = std::move(*contexts[g].vault);
+        }
+    };
+    try {
+        bool parallel = opts_.jobs > 1 && groups.size() > 1;
+        if (!parallel) {
+            for (std::size_t i = 0; i < program.size(); ++i) step(i, std::cout);
+        } else {
+            // Verbose output is buffered per block and replayed in program order, and the
+            // error reported is the one a sequential run would have hit first.
+            std::vector<std::ostringstream> logs(program.size());
+            std::vector<std::exception_ptr> failures(program.size());
+            parallel_for(groups.size(), opts_.jobs, [&](std::size_t g) {
+                for (auto i : groups[g]) {
+                    try {
+                        step(i, logs[i]);
+                    } catch (...) {
+                        failures[i] = std::current_exception();
+                        return;
+                    }
+                }
+            });
+            for (std::size_t i = 0; i < program.size(); ++i) {
+                std::cout << logs[i].str();
+                if (failures[i]) std::rethrow_exception(failures[i]);
+            }
+        }
+    } catch (...) {
+        store();
+        throw;
+    }
+    store();
+    std::vector<std::optional<SealedVault>> out(program.size());
+    for (std::size_t i = 0; i < program.size(); ++i) {
+        if (emitted[i]) out[i] = **emitted[i];
+    }
+    return out;
+}
+
+bool Interpreter::evaluate_vault(const VaultBlock &vault, EvalContext &ctx) {
+    ctx.registry.reset();
+    auto &log = *ctx.log;
+    if (vault.optional && !ctx.vault && !opts_.materializeOptional) {
+        if (opts_.verbose) log << "[skip] optional vault '" << vault.name << "' not present\n";
+        return false;
+    }
+
+    if (!ctx.vault) {
         SealedVault fresh;
         fresh.name = vault.name;
         fresh.optional = vault.optional;
@@ -52,49 +117,47 @@ void Interpreter::evaluate_vault(const VaultBlock &vault) {
         } else {
             fresh.masterKeyHex = crypto::random_key_hex();
         }
-        byName_[vault.name] = fresh;
+        ctx.vault = Cow<SealedVault>(std::move(fresh));
     } else {
-        if (opts_.forcedMasterKey && found->second.masterKeyHex != *opts_.forcedMasterKey) {
+        if (opts_.forcedMasterKey && (*ctx.vault)->masterKeyHex != *opts_.forcedMasterKey) {
             throw std::runtime_error("Master key mismatch for vault '" + vault.name + "'");
         }
         // Allow re-running scripts against existing sealed vaults by unsealing for this run.
-        auto &existingVault = found->second;
+        auto &existingVault = ctx.vault->write();
         existingVault.optional = vault.optional;
         existingVault.sealed = false;
     }
 
-    currentVault_ = vault.name;
-    if (opts_.verbose) std::cout << "[vault] " << (vault.optional ? "optional " : "required ") << vault.name << "\n";
+    if (opts_.verbose) log << "[vault] " << (vault.optional ? "optional " : "required ") << vault.name << "\n";
 
     for (const auto &stmt : vault.body) {
-        execute_statement(stmt);
+        execute_statement(stmt, ctx);
     }
-
-    auto &stored = byName_.at(vault.name);
-    sealed_.push_back(stored);
+    return true;
 }
 
-bool Interpreter::is_present(const Target &t, int line) {
-    auto &vault = byName_.at(currentVault_);
-    auto regName = resolve_registry(t, line);
+bool Interpreter::is_present(const Target &t, int line, const EvalContext &ctx) const {
+    const auto &vault = **ctx.vault;
+    auto regName = resolve_registry(t, line, ctx);
     auto regIt = vault.registries.find(regName);
     if (regIt == vault.registries.end()) return false;
-    return regIt->second.entries.find(t.key) != regIt->second.entries.end();
+    const auto &reg = *regIt->second;
+    if (reg.filter && reg.filter->keys() == reg.entries.size() && !reg.filter->may_contain(t.key)) return false;
+    return reg.entries.find(t.key) != reg.entries.end();
 }
 
-std::string Interpreter::resolve_registry(const Target &t, int line) {
+std::string Interpreter::resolve_registry(const Target &t, int line, const EvalContext &ctx) const {
     if (t.registry) return *t.registry;
-    if (currentRegistry_) return *currentRegistry_;
+    if (ctx.registry) return *ctx.registry;
     throw std::runtime_error("No active registry for target on line " + std::to_string(line));
 }
 
-std::string Interpreter::builtin_value(const ValueExpr &v) {
-    if (v.kind == ValueKind::Literal) return v.text;
-    if (v.kind == ValueKind::Document) return v.text;
+SecureString Interpreter::builtin_value(const ValueExpr &v) {
+    if (v.kind == ValueKind::Literal || v.kind == ValueKind::Document) return SecureString(v.text.begin(), v.text.end());
     if (v.text == "generate") {
-        static std::mt19937 rng{std::random_device{}()};
+        thread_local std::mt19937 rng{std::random_device{}()};
         std::uniform_int_distribution<int> dist(0, 15);
-        std::string out;
+        SecureString out;
         out.reserve(32);
         for (int i = 0; i < 32; ++i) {
             out.push_back("0123456789abcdef"[dist(rng)]);
@@ -112,64 +175,74 @@ std::string Interpreter::builtin_value(const ValueExpr &v) {
 #endif
         std::ostringstream oss;
         oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S");
-        return oss.str();
+        auto text = oss.str();
+        return SecureString(text.begin(), text.end());
     }
     throw std::runtime_error("Unknown builtin: " + v.text);
 }
 
-void Interpreter::execute_statement(const Statement &s) {
-    auto &vault = byName_.at(currentVault_);
+SealedEntry Interpreter::seal_entry(std::string_view plain, const std::string &keyHex, const std::string &salt) const {
+    auto cipher = opts_.deterministic ? crypto::encrypt_deterministic(plain, keyHex, salt) : crypto::encrypt(plain, keyHex, salt);
+    auto mac = crypto::digest(cipher, keyHex);
+    return {mac, cipher};
+}
+
+void Interpreter::execute_statement(const Statement &s, EvalContext &ctx) {
+    // `vault` is only read before any write() below, which may detach the handle
+    auto &handle = *ctx.vault;
+    const auto &vault = *handle;
+    auto &log = *ctx.log;
     switch (s.type) {
     case StatementType::Registry:
         if (vault.sealed) throw std::runtime_error("Cannot select registry after secure (line " + std::to_string(s.line) + ")");
-        currentRegistry_ = s.registryName;
-        if (opts_.verbose) std::cout << "  [registry] " << s.registryName << "\n";
+        ctx.registry = s.registryName;
+        if (opts_.verbose) log << "  [registry] " << s.registryName << "\n";
         break;
     case StatementType::If: {
-        bool present = is_present(s.conditional.target, s.line);
+        bool present = is_present(s.conditional.target, s.line, ctx);
         bool cond = s.conditional.isMissing ? !present : present;
         if (opts_.verbose) {
-            std::cout << "  [if] " << (s.conditional.isMissing ? "missing " : "present ")
-                      << "-> '" << s.conditional.target.key << "' => " << (cond ? "true" : "false") << "\n";
+            log << "  [if] " << (s.conditional.isMissing ? "missing " : "present ")
+                << "-> '" << s.conditional.target.key << "' => " << (cond ? "true" : "false") << "\n";
         }
         if (cond) {
-            for (const auto &inner : s.conditional.body) execute_statement(inner);
+            for (const auto &inner : s.conditional.body) execute_statement(inner, ctx);
         }
         break;
     }
     case StatementType::Store: {
         if (vault.sealed) throw std::runtime_error("Cannot store after secure (line " + std::to_string(s.line) + ")");
-        auto regName = resolve_registry(s.target, s.line);
-        auto &reg = vault.registries[regName];
+        auto regName = resolve_registry(s.target, s.line, ctx);
+        auto &owned = handle.write();
+        auto &reg = owned.registries[regName].write();
         if (reg.entries.count(s.target.key)) {
             throw std::runtime_error("store would overwrite existing key on line " + std::to_string(s.line));
         }
+        SecureArena::Scope scope(SecureArena::for_thread());
         auto plain = builtin_value(s.value);
         auto salt = regName + ":" + s.target.key;
-        auto cipher = crypto::encrypt(plain, vault.masterKeyHex, salt);
-        auto mac = crypto::digest(cipher, vault.masterKeyHex);
-        reg.entries[s.target.key] = {mac, cipher};
-        if (opts_.verbose) std::cout << "  [store] " << s.target.key << " (sealed)" << "\n";
+        reg.entries[s.target.key] = seal_entry(plain, owned.masterKeyHex, salt);
+        if (opts_.verbose) log << "  [store] " << s.target.key << " (sealed)" << "\n";
         break;
     }
     case StatementType::Replace: {
         if (vault.sealed) throw std::runtime_error("Cannot replace after secure (line " + std::to_string(s.line) + ")");
-        auto regName = resolve_registry(s.target, s.line);
-        auto &reg = vault.registries[regName];
+        auto regName = resolve_registry(s.target, s.line, ctx);
+        auto &owned = handle.write();
+        auto &reg = owned.registries[regName].write();
+        SecureArena::Scope scope(SecureArena::for_thread());
         auto plain = builtin_value(s.value);
         auto salt = regName + ":" + s.target.key;
-        auto cipher = crypto::encrypt(plain, vault.masterKeyHex, salt);
-        auto mac = crypto::digest(cipher, vault.masterKeyHex);
-        reg.entries[s.target.key] = {mac, cipher};
-        if (opts_.verbose) std::cout << "  [replace] " << s.target.key << " (sealed)" << "\n";
+        reg.entries[s.target.key] = seal_entry(plain, owned.masterKeyHex, salt);
+        if (opts_.verbose) log << "  [replace] " << s.target.key << " (sealed)" << "\n";
         break;
     }
     case StatementType::Note:
-        if (opts_.verbose) std::cout << "  [note] " << s.note << "\n";
+        if (opts_.verbose) log << "  [note] " << s.note << "\n";
         break;
     case StatementType::Secure:
-        vault.sealed = true;
-        if (opts_.verbose) std::cout << "  [secure] vault sealed\n";
+        handle.write().sealed = true;
+        if (opts_.verbose) log << "  [secure] vault sealed\n";
         break;
     }
 }
@@ -1,8 +1,14 @@
 #pragma once
 
 #include "ast.h"
+#include "bloom.h"
+#include "cow.h"
+#include "secure_memory.h"
 
+#include <memory>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <optional>
@@ -14,38 +20,56 @@ struct SealedEntry {
 
 struct SealedRegistry {
     std::unordered_map<std::string, SealedEntry> entries;
+    // Filter over the keys as loaded from an archive. Entries are only ever added, so it
+    // describes the current key set exactly while filter->keys() == entries.size().
+    std::shared_ptr<const BloomFilter> filter;
 };
 
 struct SealedVault {
     std::string name;
     bool optional{};
     bool sealed{};
-    std::string masterKeyHex;
-    std::unordered_map<std::string, SealedRegistry> registries;
+    WipedString masterKeyHex;
+    // Registries are shared between seeds, snapshots and archives until one of them
+    // stores into it; see Cow.
+    std::unordered_map<std::string, Cow<SealedRegistry>> registries;
 };
 
 struct InterpreterOptions {
     bool verbose{false};
     bool materializeOptional{false};
-    std::optional<std::string> forcedMasterKey;
+    // Seal with crypto::encrypt_deterministic, so unchanged values rebuild to the same bytes.
+    bool deterministic{false};
+    std::optional<WipedString> forcedMasterKey;
+    // Vault blocks with distinct names share no state, so up to this many are evaluated
+    // concurrently. Blocks that repeat a name still run in program order.
+    unsigned jobs{1};
 };
 
 class Interpreter {
   public:
     explicit Interpreter(InterpreterOptions opts);
-        void seed(const std::vector<SealedVault> &existing);
+    void seed(const std::vector<SealedVault> &existing);
     std::vector<SealedVault> run(const std::vector<VaultBlock> &program);
+    // One slot per block of `program`, empty where an optional vault was skipped. Vault
+    // state carries over between calls, so a program may be evaluated in pieces.
+    std::vector<std::optional<SealedVault>> evaluate(const std::vector<VaultBlock> &program);
 
   private:
-    void evaluate_vault(const VaultBlock &vault);
-    void execute_statement(const Statement &s);
-    bool is_present(const Target &t, int line);
-    std::string resolve_registry(const Target &t, int line);
-    std::string builtin_value(const ValueExpr &v);
+    // State of one chain of same-named vault blocks; each worker owns its own.
+    struct EvalContext {
+        std::optional<Cow<SealedVault>> vault;
+        std::optional<std::string> registry;
+        std::ostream *log{};
+    };
+
+    bool evaluate_vault(const VaultBlock &vault, EvalContext &ctx);
+    void execute_statement(const Statement &s, EvalContext &ctx);
+    bool is_present(const Target &t, int line, const EvalContext &ctx) const;
+    std::string resolve_registry(const Target &t, int line, const EvalContext &ctx) const;
+    SecureString builtin_value(const ValueExpr &v);
+    SealedEntry seal_entry(std::string_view plain, const std::string &keyHex, const std::string &salt) const;
 
     InterpreterOptions opts_{};
-    std::vector<SealedVault> sealed_;
-    std::unordered_map<std::string, SealedVault> byName_;
-    std::string currentVault_;
-    std::optional<std::string> currentRegistry_;
+    std::unordered_map<std::string, Cow<SealedVault>> byName_;
 };
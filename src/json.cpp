@@ -0,0 +1,209 @@
+#include "json.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+class JsonParser {
+  public:
+    explicit JsonParser(const std::string &text) : text_(text) {}
+
+    JsonValue parse_document() {
+        auto v = parse_value();
+        skip_ws();
+        if (pos_ != text_.size()) fail("trailing characters");
+        return v;
+    }
+
+  private:
+    [[noreturn]] void fail(const std::string &what) const {
+        throw std::runtime_error("Invalid JSON at offset " + std::to_string(pos_) + ": " + what);
+    }
+
+    void skip_ws() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) pos_++;
+    }
+
+    bool consume(const char *word) {
+        std::size_t n = 0;
+        while (word[n]) n++;
+        if (text_.compare(pos_, n, word) != 0) return false;
+        pos_ += n;
+        return true;
+    }
+
+    JsonValue parse_value() {
+        skip_ws();
+        if (pos_ >= text_.size()) fail("unexpected end");
+        char c = text_[pos_];
+        if (c == '{') return parse_object();
+        if (c == '[') return parse_array();
+        if (c == '"') return JsonValue(parse_string());
+        if (consume("true")) return JsonValue(true);
+        if (consume("false")) return JsonValue(false);
+        if (consume("null")) return JsonValue();
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            const char *start = text_.c_str() + pos_;
+            char *end = nullptr;
+            double n = std::strtod(start, &end);
+            if (end == start) fail("bad number");
+            pos_ += static_cast<std::size_t>(end - start);
+            return JsonValue(n);
+        }
+        fail("unexpected character");
+    }
+
+    JsonValue parse_object() {
+        auto obj = JsonValue::make_object();
+        pos_++;
+        skip_ws();
+        if (pos_ < text_.size() && text_[pos_] == '}') { pos_++; return obj; }
+        for (;;) {
+            skip_ws();
+            if (pos_ >= text_.size() || text_[pos_] != '"') fail("expected member name");
+            auto key = parse_string();
+            skip_ws();
+            if (pos_ >= text_.size() || text_[pos_] != ':') fail("expected ':'");
+            pos_++;
+            obj.object.emplace_back(std::move(key), parse_value());
+            skip_ws();
+            if (pos_ < text_.size() && text_[pos_] == ',') { pos_++; continue; }
+            if (pos_ < text_.size() && text_[pos_] == '}') { pos_++; return obj; }
+            fail("expected ',' or '}'");
+        }
+    }
+
+    JsonValue parse_array() {
+        auto arr = JsonValue::make_array();
+        pos_++;
+        skip_ws();
+        if (pos_ < text_.size() && text_[pos_] == ']') { pos_++; return arr; }
+        for (;;) {
+            arr.array.push_back(parse_value());
+            skip_ws();
+            if (pos_ < text_.size() && text_[pos_] == ',') { pos_++; continue; }
+            if (pos_ < text_.size() && text_[pos_] == ']') { pos_++; return arr; }
+            fail("expected ',' or ']'");
+        }
+    }
+
+    unsigned parse_hex4() {
+        if (pos_ + 4 > text_.size()) fail("short \\u escape");
+        unsigned v = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= static_cast<unsigned>(c - '0');
+            else if (c >= 'a' && c <= 'f') v |= static_cast<unsigned>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') v |= static_cast<unsigned>(c - 'A' + 10);
+            else fail("bad \\u escape");
+        }
+        return v;
+    }
+
+    void append_utf8(std::string &out, unsigned cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    // Reserves the literal's raw length first: decoding never grows a string, so a secret
+    // read from a document is not left behind in a reallocated buffer.
+    std::string parse_string() {
+        pos_++;
+        std::string out;
+        std::size_t end = pos_;
+        while (end < text_.size() && text_[end] != '"') end += text_[end] == '\\' ? 2 : 1;
+        out.reserve(std::min(end, text_.size()) - pos_);
+        while (pos_ < text_.size()) {
+            char c = text_[pos_++];
+            if (c == '"') return out;
+            if (c != '\\') {
+                out.push_back(c);
+                continue;
+            }
+            if (pos_ >= text_.size()) break;
+            char e = text_[pos_++];
+            switch (e) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                unsigned cp = parse_hex4();
+                if (cp >= 0xD800 && cp < 0xDC00 && text_.compare(pos_, 2, "\\u") == 0) {
+                    pos_ += 2;
+                    unsigned lo = parse_hex4();
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default: fail("bad escape");
+            }
+        }
+        fail("unterminated string");
+    }
+
+    const std::string &text_;
+    std::size_t pos_{};
+};
+}
+
+const JsonValue &JsonValue::operator[](const std::string &key) const {
+    static const JsonValue null;
+    if (type != Type::Object) return null;
+    for (const auto &member : object) {
+        if (member.first == key) return member.second;
+    }
+    return null;
+}
+
+JsonValue &JsonValue::set(const std::string &key, JsonValue value) {
+    type = Type::Object;
+    for (auto &member : object) {
+        if (member.first == key) return member.second = std::move(value);
+    }
+    object.emplace_back(key, std::move(value));
+    return object.back().second;
+}
+
+JsonValue &JsonValue::push(JsonValue value) {
+    type = Type::Array;
+    array.push_back(std::move(value));
+    return array.back();
+}
+
+JsonValue parse_json(const std::string &text) {
+    return JsonParser(text).parse_document();
+}
+
+std::string to_json(const JsonValue &value) {
+    std::string out;
+    append_json(out, value);
+    return out;
+}
+
+std::string json_quote(const std::string &s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    append_json_quoted(out, s);
+    return out;
+}
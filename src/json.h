@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document model for the protocol and data formats vault speaks. Objects keep
+// member order; numbers are doubles.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type{Type::Null};
+    bool boolean{};
+    double number{};
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    JsonValue() = default;
+    JsonValue(bool b) : type(Type::Bool), boolean(b) {}
+    JsonValue(int n) : type(Type::Number), number(n) {}
+    JsonValue(double n) : type(Type::Number), number(n) {}
+    JsonValue(const char *s) : type(Type::String), string(s) {}
+    JsonValue(std::string s) : type(Type::String), string(std::move(s)) {}
+
+    static JsonValue make_array() {
+        JsonValue v;
+        v.type = Type::Array;
+        return v;
+    }
+    static JsonValue make_object() {
+        JsonValue v;
+        v.type = Type::Object;
+        return v;
+    }
+
+    bool is_null() const { return type == Type::Null; }
+    // Member lookup; a shared null value when absent or when this is not an object.
+    const JsonValue &operator[](const std::string &key) const;
+    JsonValue &set(const std::string &key, JsonValue value);
+    JsonValue &push(JsonValue value);
+
+    int as_int() const { return static_cast<int>(number); }
+};
+
+JsonValue parse_json(const std::string &text);
+std::string to_json(const JsonValue &value);
+// Quoted, escaped JSON string literal.
+std::string json_quote(const std::string &s);
+// Same, appended to `out` (a std::string or SecureString) without a temporary.
+template <typename String>
+void append_json_quoted(String &out, std::string_view s) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char c : s) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += "\\u00";
+                out.push_back(hex[(c >> 4) & 0xF]);
+                out.push_back(hex[c & 0xF]);
+            } else {
+                out.push_back(c);
+            }
+        }
+    }
+    out.push_back('"');
+}
+
+// The document as to_json writes it, appended to `out` (a std::string or SecureString).
+template <typename String>
+void append_json(String &out, const JsonValue &v) {
+    switch (v.type) {
+    case JsonValue::Type::Null: out += "null"; break;
+    case JsonValue::Type::Bool: out += v.boolean ? "true" : "false"; break;
+    case JsonValue::Type::Number: {
+        char buf[32];
+        if (std::isfinite(v.number) && v.number == std::floor(v.number) && std::fabs(v.number) < 1e15) {
+            std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(v.number));
+        } else {
+            std::snprintf(buf, sizeof(buf), "%.17g", v.number);
+        }
+        out += buf;
+        break;
+    }
+    case JsonValue::Type::String: append_json_quoted(out, v.string); break;
+    case JsonValue::Type::Array: {
+        out.push_back('[');
+        for (std::size_t i = 0; i < v.array.size(); ++i) {
+            if (i) out.push_back(',');
+            append_json(out, v.array[i]);
+        }
+        out.push_back(']');
+        break;
+    }
+    case JsonValue::Type::Object: {
+        out.push_back('{');
+        for (std::size_t i = 0; i < v.object.size(); ++i) {
+            if (i) out.push_back(',');
+            append_json_quoted(out, v.object[i].first);
+            out.push_back(':');
+            append_json(out, v.object[i].second);
+        }
+        out.push_back('}');
+        break;
+    }
+    }
+}
@@ -10,24 +10,59 @@ std::string trim_left(const std::string &s) {
     if (pos == std::string::npos) return "";
     return s.substr(pos);
 }
+
+Line lex_line(const std::string &line, int number) {
+    if (line.find('\t') != std::string::npos) {
+        throw std::runtime_error("Tabs are not allowed (line " + std::to_string(number) + ")");
+    }
+    int indent = 0;
+    for (char c : line) {
+        if (c == ' ') indent++; else break;
+    }
+    return {number, indent, trim_left(line)};
+}
+
+bool is_block_header(const std::string &line) {
+    return !line.empty() && line[0] != ' ' && line.find_first_not_of(" \r") != std::string::npos;
+}
 }
 
 std::vector<Line> lex_file(const std::string &path) {
     std::ifstream in(path);
     if (!in) throw std::runtime_error("Unable to open file: " + path);
+    return lex_stream(in);
+}
+
+std::vector<Line> lex_stream(std::istream &in, int firstLine) {
     std::vector<Line> lines;
     std::string line;
-    int number = 1;
+    int number = firstLine;
     while (std::getline(in, line)) {
-        if (line.find('\t') != std::string::npos) {
-            throw std::runtime_error("Tabs are not allowed (line " + std::to_string(number) + ")");
-        }
-        int indent = 0;
-        for (char c : line) {
-            if (c == ' ') indent++; else break;
-        }
-        lines.push_back({number, indent, trim_left(line)});
+        lines.push_back(lex_line(line, number));
         number++;
     }
     return lines;
 }
+
+bool BlockLexer::next(std::vector<Line> &block) {
+    block.clear();
+    bool started = false;
+    if (header_) {
+        block.push_back(std::move(*header_));
+        header_.reset();
+        started = true;
+    }
+    std::string line;
+    while (std::getline(in_, line)) {
+        auto lexed = lex_line(line, number_++);
+        if (is_block_header(line)) {
+            if (started) {
+                header_ = std::move(lexed);
+                return true;
+            }
+            started = true;
+        }
+        block.push_back(std::move(lexed));
+    }
+    return !block.empty();
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <istream>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -10,3 +12,20 @@ struct Line {
 };
 
 std::vector<Line> lex_file(const std::string &path);
+// Lexes an in-memory fragment; line numbers start at firstLine so errors point into the file.
+std::vector<Line> lex_stream(std::istream &in, int firstLine = 1);
+
+// Lexes a script one top-level block at a time: a line starting in column 0 and the indented
+// and blank lines under it. Only one line past the block is read, so a script arriving over a
+// pipe can be parsed and run while the rest is still being written.
+class BlockLexer {
+  public:
+    explicit BlockLexer(std::istream &in, int firstLine = 1) : in_(in), number_(firstLine) {}
+    // The next block's lines; false at end of input.
+    bool next(std::vector<Line> &block);
+
+  private:
+    std::istream &in_;
+    int number_;
+    std::optional<Line> header_; // first line of the next block, already read
+};
@@ -0,0 +1,220 @@
+#include "libvault.h"
+
+#include "analysis.h"
+#include "archive.h"
+#include "config.h"
+#include "crypto.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct vault_archive {
+    LoadedArchive archive; // replayed view, master keys injected
+    std::string name;      // file name recorded in `depends` when used as a compile seed
+    VaultConfig cfg;
+};
+
+namespace {
+thread_local std::string lastError;
+
+vault_status fail(vault_status status, const std::string &message) {
+    lastError = message;
+    return status;
+}
+
+// Runs fn, turning exceptions into `status` plus vault_last_error().
+template <typename Fn>
+vault_status guarded(vault_status status, Fn fn) {
+    try {
+        return fn();
+    } catch (const std::exception &ex) {
+        return fail(status, ex.what());
+    } catch (...) {
+        return fail(VAULT_ERR_INTERNAL, "unknown error");
+    }
+}
+
+bool resolve_keys(const char *masterKeyHex, const char *token, VaultConfig &cfg) {
+    if (!masterKeyHex && !token) {
+        cfg = load_config(false);
+        return true;
+    }
+    if (!masterKeyHex || !token) return false;
+    cfg.masterKey = masterKeyHex;
+    cfg.token = token;
+    return true;
+}
+
+vault_status copy_out(std::string_view value, char *buf, size_t cap, size_t *len) {
+    if (!len) return fail(VAULT_ERR_INVALID_ARGUMENT, "len is required");
+    *len = value.size();
+    if (!buf || cap < value.size()) return fail(VAULT_ERR_BUFFER_TOO_SMALL, "buffer too small: need " + std::to_string(value.size()) + " bytes");
+    std::memcpy(buf, value.data(), value.size());
+    if (cap > value.size()) buf[value.size()] = '\0';
+    return VAULT_OK;
+}
+
+vault_status open_checked(const char *path, const char *masterKeyHex, const char *token, vault_archive &out) {
+    if (!path) return fail(VAULT_ERR_INVALID_ARGUMENT, "path is required");
+    if (!std::ifstream(path)) return fail(VAULT_ERR_IO, std::string("Unable to read: ") + path);
+    vault_status status = guarded(VAULT_ERR_IO, [&]() -> vault_status {
+        if (!resolve_keys(masterKeyHex, token, out.cfg)) return fail(VAULT_ERR_INVALID_ARGUMENT, "pass both master key and token, or neither");
+        return VAULT_OK;
+    });
+    if (status != VAULT_OK) return status;
+    // the file is readable, so anything open_archive rejects is a token, MAC or format problem
+    return guarded(VAULT_ERR_VERIFY, [&]() -> vault_status {
+        out.archive = open_archive(path, out.cfg);
+        out.name = std::filesystem::path(path).filename().string();
+        return VAULT_OK;
+    });
+}
+}
+
+extern "C" {
+
+int vault_abi_version(void) {
+    return VAULT_ABI_VERSION;
+}
+
+const char *vault_last_error(void) {
+    return lastError.c_str();
+}
+
+vault_status vault_open(const char *path, const char *master_key_hex, const char *token, vault_archive **out) {
+    if (!out) return fail(VAULT_ERR_INVALID_ARGUMENT, "out is required");
+    *out = nullptr;
+    auto handle = std::make_unique<vault_archive>();
+    auto status = open_checked(path, master_key_hex, token, *handle);
+    if (status == VAULT_OK) *out = handle.release();
+    return status;
+}
+
+vault_status vault_verify(const char *path, const char *master_key_hex, const char *token) {
+    vault_archive scratch;
+    return open_checked(path, master_key_hex, token, scratch);
+}
+
+void vault_close(vault_archive *archive) {
+    delete archive;
+}
+
+vault_status vault_get(const vault_archive *archive, const char *vault_name, const char *registry, const char *key,
+                       char *buf, size_t cap, size_t *len) {
+    if (!archive || !registry || !key) return fail(VAULT_ERR_INVALID_ARGUMENT, "archive, registry and key are required");
+    return guarded(VAULT_ERR_INTERNAL, [&]() -> vault_status {
+        const auto &vaults = archive->archive.vaults;
+        for (auto it = vaults.rbegin(); it != vaults.rend(); ++it) {
+            if (vault_name && it->name != vault_name) continue;
+            auto reg = it->registries.find(registry);
+            if (reg == it->registries.end()) continue;
+            const auto &filter = reg->second->filter;
+            if (filter && filter->keys() == reg->second->entries.size() && !filter->may_contain(key)) continue;
+            auto entry = reg->second->entries.find(key);
+            if (entry == reg->second->entries.end()) continue;
+            if (!it->sealed) return copy_out(entry->second.cipher, buf, cap, len);
+            SecureArena::Scope scope(SecureArena::for_thread());
+            auto value = crypto::decrypt(entry->second.cipher, it->masterKeyHex, std::string(registry) + ":" + key);
+            return copy_out(value, buf, cap, len);
+        }
+        return fail(VAULT_ERR_NOT_FOUND, std::string("No entry ") + registry + " -> \"" + key + "\"");
+    });
+}
+
+vault_status vault_prefix(const vault_archive *archive, const char *vault_name, const char *registry,
+                          const char *prefix, char *buf, size_t cap, size_t *len, size_t *count) {
+    if (!archive || !registry) return fail(VAULT_ERR_INVALID_ARGUMENT, "archive and registry are required");
+    return guarded(VAULT_ERR_INTERNAL, [&]() -> vault_status {
+        std::string want = prefix ? prefix : "";
+        std::set<std::string> keys;
+        for (const auto &v : archive->archive.vaults) {
+            if (vault_name && v.name != vault_name) continue;
+            auto reg = v.registries.find(registry);
+            if (reg == v.registries.end()) continue;
+            for (const auto &entry : reg->second->entries) {
+                if (entry.first.compare(0, want.size(), want) == 0) keys.insert(entry.first);
+            }
+        }
+        std::string packed;
+        for (const auto &k : keys) {
+            packed += k;
+            packed.push_back('\0');
+        }
+        if (count) *count = keys.size();
+        return copy_out(packed, buf, cap, len);
+    });
+}
+
+vault_status vault_compile(const char *script, size_t script_len, const vault_archive *seed, const char *master_key_hex,
+                           const char *token, vault_archive **out) {
+    if (!out || (!script && script_len)) return fail(VAULT_ERR_INVALID_ARGUMENT, "script and out are required");
+    *out = nullptr;
+    auto handle = std::make_unique<vault_archive>();
+    auto status = guarded(VAULT_ERR_INVALID_ARGUMENT, [&]() -> vault_status {
+        if (!resolve_keys(master_key_hex, token, handle->cfg)) return fail(VAULT_ERR_INVALID_ARGUMENT, "pass both master key and token, or neither");
+        if (seed && (seed->cfg.token != handle->cfg.token || seed->cfg.masterKey != handle->cfg.masterKey)) {
+            return fail(VAULT_ERR_INVALID_ARGUMENT, "seed archive was opened under different keys");
+        }
+        return VAULT_OK;
+    });
+    if (status != VAULT_OK) return status;
+    status = guarded(VAULT_ERR_COMPILE, [&]() -> vault_status {
+        std::istringstream in(std::string(script ? script : "", script_len));
+        Parser parser(lex_stream(in));
+        auto program = parser.parse();
+        const auto &cfg = handle->cfg;
+        auto &built = handle->archive;
+        std::vector<std::string> seeded;
+        if (seed) {
+            for (const auto &v : seed->archive.vaults) seeded.push_back(v.name);
+            built.dependencies = seed->archive.dependencies;
+            if (!seed->name.empty()) built.dependencies.push_back(seed->name);
+            built.dependencies = sorted_unique(std::move(built.dependencies));
+        }
+        prune_program(program, seeded, false);
+        InterpreterOptions opts{};
+        opts.forcedMasterKey = cfg.masterKey;
+        Interpreter interp(opts);
+        if (seed) interp.seed(seed->archive.vaults);
+        built.vaults = interp.run(program);
+        built.token = cfg.token;
+        built.hmac = compute_archive_hmac(built.vaults, cfg.token, cfg.masterKey, built.dependencies);
+        return VAULT_OK;
+    });
+    if (status == VAULT_OK) *out = handle.release();
+    return status;
+}
+
+vault_status vault_serialize(const vault_archive *archive, char *buf, size_t cap, size_t *len) {
+    if (!archive) return fail(VAULT_ERR_INVALID_ARGUMENT, "archive is required");
+    return guarded(VAULT_ERR_INTERNAL, [&]() -> vault_status {
+        const auto &a = archive->archive;
+        std::ostringstream text;
+        write_svau(text, a.vaults, archive->cfg.token, archive->cfg.masterKey, a.dependencies);
+        text << "hmac " << compute_archive_hmac(a.vaults, archive->cfg.token, archive->cfg.masterKey, a.dependencies) << "\n";
+        return copy_out(text.str(), buf, cap, len);
+    });
+}
+
+vault_status vault_write(const vault_archive *archive, const char *path) {
+    if (!archive || !path) return fail(VAULT_ERR_INVALID_ARGUMENT, "archive and path are required");
+    return guarded(VAULT_ERR_IO, [&]() -> vault_status {
+        const auto &a = archive->archive;
+        auto hmac = compute_archive_hmac(a.vaults, archive->cfg.token, archive->cfg.masterKey, a.dependencies);
+        write_svau_file(path, a.vaults, archive->cfg.token, archive->cfg.masterKey, a.dependencies, hmac);
+        return VAULT_OK;
+    });
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/* Stable C interface to the vault engine, for embedding without spawning vaultc.
+ *
+ * Archives are opaque handles. Functions return a vault_status code; on failure
+ * vault_last_error() describes the problem. Strings are returned in caller-provided
+ * buffers: on success *len receives the byte count written (a terminating NUL is added
+ * when it fits); when the buffer is too small the call returns
+ * VAULT_ERR_BUFFER_TOO_SMALL with *len set to the size required, excluding the NUL.
+ *
+ * Keys: pass the master key (hex) and token explicitly, or NULL for both to read them
+ * from .vault/var.vc in the working directory. Handles are immutable once created and
+ * may be read from several threads.
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(VAULT_SHARED)
+#  ifdef VAULT_BUILDING_LIBRARY
+#    define VAULT_API __declspec(dllexport)
+#  else
+#    define VAULT_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define VAULT_API __attribute__((visibility("default")))
+#else
+#  define VAULT_API
+#endif
+
+#define VAULT_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    VAULT_OK = 0,
+    VAULT_ERR_INVALID_ARGUMENT = 1,
+    VAULT_ERR_IO = 2,
+    VAULT_ERR_VERIFY = 3, /* token mismatch, bad HMAC or malformed archive */
+    VAULT_ERR_NOT_FOUND = 4,
+    VAULT_ERR_BUFFER_TOO_SMALL = 5,
+    VAULT_ERR_COMPILE = 6,
+    VAULT_ERR_INTERNAL = 7
+};
+typedef int vault_status;
+
+typedef struct vault_archive vault_archive;
+
+VAULT_API int vault_abi_version(void);
+/* Message for the last failed call on this thread; never NULL. Valid until the next
+ * call into the library on the same thread. */
+VAULT_API const char *vault_last_error(void);
+
+/* Reads, authenticates and replays an archive. */
+VAULT_API vault_status vault_open(const char *path, const char *master_key_hex, const char *token, vault_archive **out);
+/* Token, HMAC and segment chain checks only; nothing is decrypted. */
+VAULT_API vault_status vault_verify(const char *path, const char *master_key_hex, const char *token);
+VAULT_API void vault_close(vault_archive *archive);
+
+/* Decrypted value of registry/key. vault_name may be NULL to search every vault; the
+ * latest record of a repeated vault wins. */
+VAULT_API vault_status vault_get(const vault_archive *archive, const char *vault_name, const char *registry,
+                                 const char *key, char *buf, size_t cap, size_t *len);
+/* Sorted, de-duplicated keys of `registry` starting with `prefix` (NULL or "" for all),
+ * written back to back, each terminated by NUL. *count receives the number of keys. */
+VAULT_API vault_status vault_prefix(const vault_archive *archive, const char *vault_name, const char *registry,
+                                    const char *prefix, char *buf, size_t cap, size_t *len, size_t *count);
+
+/* Compiles a .vau script held in memory. `seed` (may be NULL) plays the role of --load. */
+VAULT_API vault_status vault_compile(const char *script, size_t script_len, const vault_archive *seed,
+                                     const char *master_key_hex, const char *token, vault_archive **out);
+/* The archive as .svau text; segments of an opened archive are folded into one base. */
+VAULT_API vault_status vault_serialize(const vault_archive *archive, char *buf, size_t cap, size_t *len);
+/* Writes the archive to path atomically (temp file, fsync, rename). */
+VAULT_API vault_status vault_write(const vault_archive *archive, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
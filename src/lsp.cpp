@@ -0,0 +1,466 @@
+// vault-lsp: language server for .vau scripts over stdio (JSON-RPC with Content-Length
+// framing). Each open document is kept as lines plus a list of top-level blocks, and an
+// edit re-lexes and re-parses only the blocks it touches, so large generated scripts stay
+// responsive while typing.
+
+#include "ast.h"
+#include "json.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+// One top-level block: a line starting in column 0 and the indented and blank lines under
+// it. The AST is parsed with line numbers relative to the block (first line = 1), so
+// edits elsewhere only move `start`.
+struct Block {
+    int start{};
+    int length{};
+    std::vector<VaultBlock> ast;
+    std::string error;
+    int errorLine{}; // 0-based, relative to start
+};
+
+bool is_header(const std::string &line) {
+    return !line.empty() && line[0] != ' ' && line.find_first_not_of(" \r") != std::string::npos;
+}
+
+std::vector<std::string> split_lines(const std::string &text) {
+    std::vector<std::string> lines;
+    std::string::size_type begin = 0;
+    for (;;) {
+        auto nl = text.find('\n', begin);
+        auto line = text.substr(begin, nl == std::string::npos ? std::string::npos : nl - begin);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        lines.push_back(std::move(line));
+        if (nl == std::string::npos) break;
+        begin = nl + 1;
+    }
+    return lines;
+}
+
+// LSP positions count UTF-16 code units; lines are stored as UTF-8.
+std::size_t utf16_to_byte(const std::string &line, int character) {
+    std::size_t i = 0;
+    int units = 0;
+    while (i < line.size() && units < character) {
+        auto c = static_cast<unsigned char>(line[i]);
+        std::size_t len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+        units += len == 4 ? 2 : 1;
+        i += len;
+    }
+    return std::min(i, line.size());
+}
+
+int utf16_length(const std::string &line) {
+    int units = 0;
+    for (std::size_t i = 0; i < line.size();) {
+        auto c = static_cast<unsigned char>(line[i]);
+        std::size_t len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+        units += len == 4 ? 2 : 1;
+        i += len;
+    }
+    return units;
+}
+
+JsonValue position(int line, int character) {
+    auto p = JsonValue::make_object();
+    p.set("line", line);
+    p.set("character", character);
+    return p;
+}
+
+JsonValue range(int startLine, int startChar, int endLine, int endChar) {
+    auto r = JsonValue::make_object();
+    r.set("start", position(startLine, startChar));
+    r.set("end", position(endLine, endChar));
+    return r;
+}
+
+std::string describe_target(const Target &t, const std::optional<std::string> &active) {
+    auto reg = t.registry ? *t.registry : active ? *active : std::string("?");
+    return "`" + reg + " -> \"" + t.key + "\"`";
+}
+
+std::string describe_value(const ValueExpr &v) {
+    switch (v.kind) {
+    case ValueKind::Literal: return "literal";
+    case ValueKind::Builtin: return "builtin `" + v.text + "()`";
+    case ValueKind::Document: return "document";
+    }
+    return "";
+}
+
+// Finds the statement on `line` (block-relative, 1-based), tracking the active registry
+// the way the interpreter would along the straight-line path to it.
+const Statement *find_statement(const std::vector<Statement> &body, int line, std::optional<std::string> &active) {
+    for (const auto &s : body) {
+        if (s.line == line) return &s;
+        if (s.type == StatementType::Registry) active = s.registryName;
+        if (s.type == StatementType::If) {
+            auto inner = active;
+            if (auto *found = find_statement(s.conditional.body, line, inner)) {
+                active = inner;
+                return found;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void count_statements(const std::vector<Statement> &body, int &registries, int &keys) {
+    for (const auto &s : body) {
+        if (s.type == StatementType::Registry) registries++;
+        if (s.type == StatementType::Store || s.type == StatementType::Replace) keys++;
+        if (s.type == StatementType::If) count_statements(s.conditional.body, registries, keys);
+    }
+}
+
+class Document {
+  public:
+    Document() { reset(""); }
+
+    void reset(const std::string &text) {
+        lines_ = split_lines(text);
+        blocks_ = chunk(0, static_cast<int>(lines_.size()));
+    }
+
+    void apply(const JsonValue &r, const std::string &text) {
+        int sl = std::clamp(r["start"]["line"].as_int(), 0, static_cast<int>(lines_.size()) - 1);
+        int el = std::clamp(r["end"]["line"].as_int(), sl, static_cast<int>(lines_.size()) - 1);
+        auto sc = utf16_to_byte(lines_[sl], r["start"]["character"].as_int());
+        auto ec = utf16_to_byte(lines_[el], r["end"]["character"].as_int());
+        auto replaced = split_lines(lines_[sl].substr(0, sc) + text + lines_[el].substr(ec));
+        int delta = static_cast<int>(replaced.size()) - (el - sl + 1);
+
+        // blocks overlapping the edited lines; the block before joins in when the edit
+        // starts on a header, since that header may have stopped being one
+        auto first = block_at(sl);
+        if (first > 0 && blocks_[first].start == sl) first--;
+        auto last = block_at(el) + 1;
+        int from = blocks_[first].start;
+        int to = blocks_[last - 1].start + blocks_[last - 1].length;
+
+        lines_.erase(lines_.begin() + sl, lines_.begin() + el + 1);
+        lines_.insert(lines_.begin() + sl, std::make_move_iterator(replaced.begin()), std::make_move_iterator(replaced.end()));
+
+        auto rebuilt = chunk(from, to + delta);
+        for (auto i = last; i < blocks_.size(); ++i) blocks_[i].start += delta;
+        blocks_.erase(blocks_.begin() + static_cast<std::ptrdiff_t>(first), blocks_.begin() + static_cast<std::ptrdiff_t>(last));
+        blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(first), std::make_move_iterator(rebuilt.begin()),
+                       std::make_move_iterator(rebuilt.end()));
+    }
+
+    JsonValue diagnostics() const {
+        auto out = JsonValue::make_array();
+        for (const auto &b : blocks_) {
+            if (b.error.empty()) continue;
+            int line = b.start + b.errorLine;
+            auto d = JsonValue::make_object();
+            d.set("range", range(line, 0, line, utf16_length(lines_[line])));
+            d.set("severity", 1);
+            d.set("source", "vault");
+            d.set("message", b.error);
+            out.push(std::move(d));
+        }
+        return out;
+    }
+
+    JsonValue symbols() const {
+        auto out = JsonValue::make_array();
+        for (const auto &b : blocks_) {
+            for (const auto &v : b.ast) {
+                int first = b.start + v.line - 1;
+                int last = b.start + b.length - 1;
+                while (last > first && lines_[last].find_first_not_of(' ') == std::string::npos) last--;
+                auto sym = JsonValue::make_object();
+                sym.set("name", v.name);
+                sym.set("detail", v.optional ? "optional" : "required");
+                sym.set("kind", 2); // Module
+                sym.set("range", range(first, 0, last, utf16_length(lines_[last])));
+                sym.set("selectionRange", range(first, 0, first, utf16_length(lines_[first])));
+                auto children = JsonValue::make_array();
+                statement_symbols(v.body, b.start, children);
+                sym.set("children", std::move(children));
+                out.push(std::move(sym));
+            }
+        }
+        return out;
+    }
+
+    JsonValue hover(int line) const {
+        auto bi = block_at(line);
+        if (bi >= blocks_.size()) return JsonValue();
+        const auto &b = blocks_[bi];
+        int rel = line - b.start + 1;
+        std::string text;
+        for (const auto &v : b.ast) {
+            if (v.line == rel) {
+                int registries = 0, keys = 0;
+                count_statements(v.body, registries, keys);
+                text = "**vault** `" + v.name + "` (" + (v.optional ? "optional" : "required") + ") — " +
+                       std::to_string(registries) + " registry statement(s), " + std::to_string(keys) + " store/replace";
+                break;
+            }
+            std::optional<std::string> active;
+            auto *s = find_statement(v.body, rel, active);
+            if (!s) continue;
+            switch (s->type) {
+            case StatementType::Registry: text = "**registry** `" + s->registryName + "` — default for targets without a registry"; break;
+            case StatementType::If:
+                text = std::string("**if ") + (s->conditional.isMissing ? "missing" : "present") + "** " +
+                       describe_target(s->conditional.target, active) + " — " + std::to_string(s->conditional.body.size()) + " statement(s)";
+                break;
+            case StatementType::Store: text = "**store** " + describe_target(s->target, active) + " = " + describe_value(s->value) + "; fails if the key exists"; break;
+            case StatementType::Replace: text = "**replace** " + describe_target(s->target, active) + " = " + describe_value(s->value); break;
+            case StatementType::Note: text = "**note** — recorded only in verbose output"; break;
+            case StatementType::Secure: text = "**secure** — seals vault `" + v.name + "`; later statements are rejected"; break;
+            }
+            break;
+        }
+        if (text.empty()) return JsonValue();
+        auto contents = JsonValue::make_object();
+        contents.set("kind", "markdown");
+        contents.set("value", text);
+        auto result = JsonValue::make_object();
+        result.set("contents", std::move(contents));
+        result.set("range", range(line, 0, line, utf16_length(lines_[line])));
+        return result;
+    }
+
+  private:
+    // Index of the block holding `line`; a document always has at least one block.
+    std::size_t block_at(int line) const {
+        auto it = std::upper_bound(blocks_.begin(), blocks_.end(), line, [](int l, const Block &b) { return l < b.start; });
+        return it == blocks_.begin() ? 0 : static_cast<std::size_t>(it - blocks_.begin() - 1);
+    }
+
+    // Splits lines [from, to) into blocks and parses each one.
+    std::vector<Block> chunk(int from, int to) const {
+        std::vector<Block> out;
+        for (int i = from; i < to; ++i) {
+            if (out.empty() || is_header(lines_[i])) out.push_back({i, 0, {}, {}, 0});
+            out.back().length++;
+        }
+        for (auto &b : out) parse(b);
+        return out;
+    }
+
+    void parse(Block &b) const {
+        static const std::regex lineRef("line ([0-9]+)");
+        std::string text;
+        for (int i = 0; i < b.length; ++i) {
+            text += lines_[b.start + i];
+            text += '\n';
+        }
+        try {
+            std::istringstream in(text);
+            Parser parser(lex_stream(in));
+            b.ast = parser.parse();
+        } catch (const std::exception &ex) {
+            b.error = ex.what();
+            std::smatch m;
+            int rel = std::regex_search(b.error, m, lineRef) ? std::stoi(m[1]) : 1;
+            b.errorLine = std::clamp(rel - 1, 0, b.length - 1);
+            // report document line numbers, not block-relative ones
+            b.error = std::regex_replace(b.error, lineRef, "line " + std::to_string(b.start + rel));
+        }
+    }
+
+    void statement_symbols(const std::vector<Statement> &body, int start, JsonValue &out) const {
+        for (const auto &s : body) {
+            int line = start + s.line - 1;
+            auto r = range(line, 0, line, utf16_length(lines_[line]));
+            if (s.type == StatementType::Registry) {
+                auto sym = JsonValue::make_object();
+                sym.set("name", s.registryName);
+                sym.set("kind", 3); // Namespace
+                sym.set("range", r);
+                sym.set("selectionRange", r);
+                out.push(std::move(sym));
+            } else if (s.type == StatementType::Store || s.type == StatementType::Replace) {
+                auto sym = JsonValue::make_object();
+                sym.set("name", s.target.key);
+                sym.set("detail", (s.type == StatementType::Store ? "store" : "replace") +
+                                      (s.target.registry ? " " + *s.target.registry : std::string()));
+                sym.set("kind", 20); // Key
+                sym.set("range", r);
+                sym.set("selectionRange", r);
+                out.push(std::move(sym));
+            } else if (s.type == StatementType::If) {
+                statement_symbols(s.conditional.body, start, out);
+            }
+        }
+    }
+
+    std::vector<std::string> lines_;
+    std::vector<Block> blocks_;
+};
+
+std::optional<std::string> read_message(std::istream &in) {
+    std::size_t length = 0;
+    bool sized = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) {
+            if (sized) break;
+            continue;
+        }
+        auto colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        auto name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (name == "content-length") {
+            length = std::stoul(line.substr(colon + 1));
+            sized = true;
+        }
+    }
+    if (!sized) return std::nullopt;
+    std::string body(length, '\0');
+    in.read(&body[0], static_cast<std::streamsize>(length));
+    if (static_cast<std::size_t>(in.gcount()) != length) return std::nullopt;
+    return body;
+}
+
+void send(const JsonValue &message) {
+    auto body = to_json(message);
+    std::cout << "Content-Length: " << body.size() << "\r\n\r\n" << body;
+    std::cout.flush();
+}
+
+void respond(const JsonValue &id, JsonValue result) {
+    auto msg = JsonValue::make_object();
+    msg.set("jsonrpc", "2.0");
+    msg.set("id", id);
+    msg.set("result", std::move(result));
+    send(msg);
+}
+
+void respond_error(const JsonValue &id, int code, const std::string &message) {
+    auto error = JsonValue::make_object();
+    error.set("code", code);
+    error.set("message", message);
+    auto msg = JsonValue::make_object();
+    msg.set("jsonrpc", "2.0");
+    msg.set("id", id);
+    msg.set("error", std::move(error));
+    send(msg);
+}
+
+void notify(const std::string &method, JsonValue params) {
+    auto msg = JsonValue::make_object();
+    msg.set("jsonrpc", "2.0");
+    msg.set("method", method);
+    msg.set("params", std::move(params));
+    send(msg);
+}
+
+class Server {
+  public:
+    // Returns the process exit code once `exit` arrives or input ends.
+    int run() {
+        while (auto body = read_message(std::cin)) {
+            JsonValue msg;
+            try {
+                msg = parse_json(*body);
+            } catch (const std::exception &ex) {
+                respond_error(JsonValue(), -32700, ex.what());
+                continue;
+            }
+            const auto &method = msg["method"].string;
+            const auto &id = msg["id"];
+            if (method == "exit") return shutdown_ ? 0 : 1;
+            try {
+                handle(method, id, msg["params"]);
+            } catch (const std::exception &ex) {
+                if (!id.is_null()) respond_error(id, -32603, ex.what());
+            }
+        }
+        return 1;
+    }
+
+  private:
+    void handle(const std::string &method, const JsonValue &id, const JsonValue &params) {
+        if (method == "initialize") {
+            auto sync = JsonValue::make_object();
+            sync.set("openClose", true);
+            sync.set("change", 2); // incremental
+            auto caps = JsonValue::make_object();
+            caps.set("textDocumentSync", std::move(sync));
+            caps.set("documentSymbolProvider", true);
+            caps.set("hoverProvider", true);
+            auto info = JsonValue::make_object();
+            info.set("name", "vault-lsp");
+            auto result = JsonValue::make_object();
+            result.set("capabilities", std::move(caps));
+            result.set("serverInfo", std::move(info));
+            respond(id, std::move(result));
+        } else if (method == "shutdown") {
+            shutdown_ = true;
+            respond(id, JsonValue());
+        } else if (method == "textDocument/didOpen") {
+            const auto &doc = params["textDocument"];
+            docs_[doc["uri"].string].reset(doc["text"].string);
+            publish(doc["uri"].string);
+        } else if (method == "textDocument/didChange") {
+            const auto &uri = params["textDocument"]["uri"].string;
+            auto &doc = docs_[uri];
+            for (const auto &change : params["contentChanges"].array) {
+                if (change["range"].is_null()) doc.reset(change["text"].string);
+                else doc.apply(change["range"], change["text"].string);
+            }
+            publish(uri);
+        } else if (method == "textDocument/didClose") {
+            const auto &uri = params["textDocument"]["uri"].string;
+            docs_.erase(uri);
+            auto cleared = JsonValue::make_object();
+            cleared.set("uri", uri);
+            cleared.set("diagnostics", JsonValue::make_array());
+            notify("textDocument/publishDiagnostics", std::move(cleared));
+        } else if (method == "textDocument/documentSymbol") {
+            auto found = docs_.find(params["textDocument"]["uri"].string);
+            respond(id, found == docs_.end() ? JsonValue::make_array() : found->second.symbols());
+        } else if (method == "textDocument/hover") {
+            auto found = docs_.find(params["textDocument"]["uri"].string);
+            respond(id, found == docs_.end() ? JsonValue() : found->second.hover(params["position"]["line"].as_int()));
+        } else if (!id.is_null()) {
+            respond_error(id, -32601, "Method not found: " + method);
+        }
+    }
+
+    void publish(const std::string &uri) {
+        auto params = JsonValue::make_object();
+        params.set("uri", uri);
+        params.set("diagnostics", docs_[uri].diagnostics());
+        notify("textDocument/publishDiagnostics", std::move(params));
+    }
+
+    std::unordered_map<std::string, Document> docs_;
+    bool shutdown_{false};
+};
+}
+
+int main() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::ios::sync_with_stdio(false);
+    return Server().run();
+}
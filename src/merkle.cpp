@@ -0,0 +1,77 @@
+#include "merkle.h"
+
+#include "crypto.h"
+
+void append_page_entry(std::string &material, const std::string &key, const std::string &digest, const std::string &cipher) {
+    material += key;
+    material.push_back('\n');
+    material += digest;
+    material.push_back('\n');
+    material += cipher;
+    material.push_back('\n');
+}
+
+std::string merkle_page_hash(const std::string &material) {
+    return crypto::digest("page\n" + material);
+}
+
+std::string merkle_registry_leaf(const std::string &vault, const std::string &registry, bool latest, std::size_t count,
+                                 const std::vector<std::string> &pages, const std::string &filterHex) {
+    return crypto::digest("registry " + vault + " " + registry + (latest ? " latest " : " prior ") + std::to_string(count) + "\n" +
+                          merkle_root(pages) + "\n" + crypto::digest("filter " + filterHex));
+}
+
+std::string merkle_vault_leaf(const std::string &vault, bool optional, bool sealed) {
+    return crypto::digest(std::string("vault ") + vault + (optional ? " optional" : " required") + (sealed ? " sealed" : " open"));
+}
+
+std::string merkle_header_leaf(const std::vector<std::string> &dependencies) {
+    std::string material = "header\n";
+    for (const auto &d : dependencies) material += "depends " + d + "\n";
+    return crypto::digest(material);
+}
+
+std::vector<std::vector<std::string>> merkle_tree(std::vector<std::string> leaves) {
+    std::vector<std::vector<std::string>> tree;
+    if (leaves.empty()) leaves.push_back(crypto::digest("empty"));
+    tree.push_back(std::move(leaves));
+    while (tree.back().size() > 1) {
+        const auto &level = tree.back();
+        std::vector<std::string> next;
+        next.reserve((level.size() + 1) / 2);
+        for (std::size_t i = 0; i + 1 < level.size(); i += 2) next.push_back(crypto::digest("node " + level[i] + level[i + 1]));
+        if (level.size() % 2) next.push_back(level.back());
+        tree.push_back(std::move(next));
+    }
+    return tree;
+}
+
+std::string merkle_root(std::vector<std::string> leaves) {
+    return merkle_tree(std::move(leaves)).back().front();
+}
+
+std::vector<std::string> merkle_path(const std::vector<std::vector<std::string>> &tree, std::size_t index) {
+    std::vector<std::string> path;
+    for (std::size_t depth = 0; depth + 1 < tree.size(); ++depth, index /= 2) {
+        auto sibling = index ^ 1;
+        if (sibling < tree[depth].size()) path.push_back(tree[depth][sibling]);
+    }
+    return path;
+}
+
+std::string merkle_root_from_path(std::string leaf, std::size_t index, std::size_t count, const std::vector<std::string> &path) {
+    if (index >= count) return {};
+    std::size_t used = 0;
+    for (; count > 1; index /= 2, count = (count + 1) / 2) {
+        auto sibling = index ^ 1;
+        if (sibling >= count) continue;
+        if (used == path.size()) return {};
+        const auto &other = path[used++];
+        leaf = crypto::digest("node " + (index % 2 ? other + leaf : leaf + other));
+    }
+    return used == path.size() ? leaf : std::string();
+}
+
+std::string merkle_mac(const std::string &root, std::size_t count, const std::string &token, const std::string &masterKeyHex) {
+    return crypto::digest("merkle " + token + " " + std::to_string(count) + "\n" + root, masterKeyHex);
+}
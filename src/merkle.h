@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Merkle authentication for archives, alongside the whole-archive `hmac`.
+//
+// Each registry's entries, in key order, are cut into pages of kMerklePageEntries; a page hash
+// covers the page's entry records. A registry leaf binds the vault and registry names, the
+// entry count, the root over its page hashes and its Bloom filter. The archive root is the
+// tree over a header leaf (depends), then per vault record a vault leaf followed by its
+// registry leaves. Leaves are plain hashes of what the header already shows; the token and
+// leaf count are bound only by the root MAC under the master key. The header stores the
+// authentication path (sibling hashes) of every leaf the index serves, so a reader that needs
+// one registry hashes that leaf up its path to the root, and then only the pages it reads.
+
+constexpr std::size_t kMerklePageEntries = 64;
+
+void append_page_entry(std::string &material, const std::string &key, const std::string &digest, const std::string &cipher);
+std::string merkle_page_hash(const std::string &material);
+// `latest` marks the registry in the last record of its vault, the one the index serves;
+// filterHex is empty for registries that carry no filter.
+std::string merkle_registry_leaf(const std::string &vault, const std::string &registry, bool latest, std::size_t count,
+                                 const std::vector<std::string> &pages, const std::string &filterHex);
+std::string merkle_vault_leaf(const std::string &vault, bool optional, bool sealed);
+std::string merkle_header_leaf(const std::vector<std::string> &dependencies);
+// Every level of the tree, leaves first and the root last; pairs are hashed and an odd node
+// is carried up unchanged.
+std::vector<std::vector<std::string>> merkle_tree(std::vector<std::string> leaves);
+std::string merkle_root(std::vector<std::string> leaves);
+// The sibling hashes from leaf `index` up to the root; a level that carries the node up
+// contributes none.
+std::vector<std::string> merkle_path(const std::vector<std::vector<std::string>> &tree, std::size_t index);
+// The root that `leaf`, at `index` of `count` leaves, hashes up to along `path`; empty when the
+// path does not fit a tree of that size.
+std::string merkle_root_from_path(std::string leaf, std::size_t index, std::size_t count, const std::vector<std::string> &path);
+std::string merkle_mac(const std::string &root, std::size_t count, const std::string &token, const std::string &masterKeyHex);
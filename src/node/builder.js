@@ -1,7 +1,7 @@
 const fs = require("fs");
 const path = require("path");
-const { buildProgram } = require("./structure");
-const { compileVau, inspectArchive } = require("./vault");
+const { buildProgram, streamProgram } = require("./structure");
+const { compileStream, inspectArchive } = require("./vault");
 const { ensureDir, workspaceRoot } = require("./design");
 
 async function writeVau(model, outPath) {
@@ -11,12 +11,34 @@ async function writeVau(model, outPath) {
   return outPath;
 }
 
-async function buildArchive(model, { vauPath, svauPath, loads = [] } = {}) {
+// Yields `chunks` unchanged, writing each one to `outPath` on the way through.
+function* teeToFile(chunks, outPath) {
+  ensureDir(path.dirname(outPath));
+  const fd = fs.openSync(outPath, "w");
+  try {
+    for (const chunk of chunks) {
+      fs.writeSync(fd, chunk, null, "utf8");
+      yield chunk;
+    }
+  } finally {
+    fs.closeSync(fd);
+  }
+}
+
+// The program is streamed into the compiler block by block and written to the .vau path as it
+// goes, so the returned script is the one that was compiled without being rendered twice.
+async function buildArchive(model, { vauPath, svauPath, loads = [], append = false } = {}) {
   const root = workspaceRoot();
   const vau = vauPath || path.join(root, "build", "model.vau");
   const svau = svauPath || path.join(root, "build", "model.svau");
-  await writeVau(model, vau);
-  await compileVau(vau, svau, loads);
+  ensureDir(path.dirname(svau));
+  const blocks = teeToFile(streamProgram(model), vau);
+  if (append && loads.length === 0 && fs.existsSync(svau)) {
+    // re-deploys only append the delta; run `vault <svau> --compact` to fold segments
+    await compileStream(blocks, svau, [svau], { append: true });
+  } else {
+    await compileStream(blocks, svau, loads);
+  }
   return { vau, svau };
 }
 
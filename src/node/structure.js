@@ -50,4 +50,10 @@ function buildProgram(vaults) {
   return vaults.map(renderVault).join("\n\n");
 }
 
-module.exports = { buildProgram };
+// The same program one vault block at a time, rendered only when the consumer asks for it;
+// `vaults` may be any iterable, including a generator producing the model lazily.
+function* streamProgram(vaults) {
+  for (const vault of vaults) yield `${renderVault(vault)}\n\n`;
+}
+
+module.exports = { buildProgram, streamProgram };
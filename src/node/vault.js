@@ -1,5 +1,5 @@
 // Lightweight Node wrapper around vault.exe
-const { execFile } = require("child_process");
+const { execFile, spawn } = require("child_process");
 const path = require("path");
 const { resolveVaultBin, workspaceRoot } = require("./design");
 
@@ -7,7 +7,7 @@ const VAULT_BIN = resolveVaultBin();
 
 function runVault(args, options = {}) {
   return new Promise((resolve, reject) => {
-    execFile(VAULT_BIN, args, { cwd: options.cwd || workspaceRoot() }, (err, stdout, stderr) => {
+    execFile(VAULT_BIN, args, { cwd: options.cwd || workspaceRoot(), maxBuffer: options.maxBuffer || 256 * 1024 * 1024 }, (err, stdout, stderr) => {
       if (err) {
         const error = new Error(stderr || err.message);
         error.code = err.code;
@@ -18,21 +18,87 @@ function runVault(args, options = {}) {
   });
 }
 
-async function compileVau(inputVau, outputSvau, extraLoads = []) {
-  const args = [inputVau, "--out", outputSvau, ...extraLoads.flatMap(d => ["--load", d])];
+async function compileVau(inputVau, outputSvau, extraLoads = [], { append = false } = {}) {
+  // append: write only the changed records as a segment onto the loaded archive
+  const args = append
+    ? [inputVau, ...extraLoads.flatMap(d => ["--load", d]), "--append"]
+    : [inputVau, "--out", outputSvau, ...extraLoads.flatMap(d => ["--load", d])];
   return runVault(args);
 }
 
-async function inspectArchive(archivePath, { hideMac = false } = {}) {
+// Compile a script streamed from `blocks` (an iterable of text chunks) through the child's stdin
+// (`vault -`). The compiler parses and seals each block while later ones are still being
+// produced, and no script file is written.
+function compileStream(blocks, outputSvau, extraLoads = [], { append = false, cwd } = {}) {
+  const args = append
+    ? ["-", ...extraLoads.flatMap(d => ["--load", d]), "--append"]
+    : ["-", "--out", outputSvau, ...extraLoads.flatMap(d => ["--load", d])];
+  return new Promise((resolve, reject) => {
+    const child = spawn(VAULT_BIN, args, { cwd: cwd || workspaceRoot(), stdio: ["pipe", "pipe", "pipe"] });
+    let stdout = "";
+    let stderr = "";
+    child.stdout.setEncoding("utf8").on("data", d => (stdout += d));
+    child.stderr.setEncoding("utf8").on("data", d => (stderr += d));
+    child.on("error", reject);
+    child.on("close", code => {
+      if (code !== 0) {
+        const error = new Error(stderr || `vault exited with code ${code}`);
+        error.code = code;
+        return reject(error);
+      }
+      resolve({ stdout, stderr });
+    });
+    // an early compiler error closes the pipe; the exit code reports it
+    child.stdin.on("error", () => {});
+
+    (async () => {
+      for (const chunk of blocks) {
+        if (child.stdin.destroyed) return;
+        if (!child.stdin.write(chunk, "utf8")) {
+          await new Promise(done => {
+            const resume = () => {
+              child.stdin.off("drain", resume);
+              child.stdin.off("close", resume);
+              done();
+            };
+            child.stdin.on("drain", resume);
+            child.stdin.on("close", resume);
+          });
+        }
+      }
+      child.stdin.end();
+    })().catch(err => {
+      child.kill();
+      reject(err);
+    });
+  });
+}
+
+// Compile many scripts in one vault process; config and shared --load seeds are read once.
+async function compileMany(inputs, outDir, { load, jobs } = {}) {
+  const args = ["build", ...inputs, "--out-dir", outDir];
+  if (load) args.push("--load", load);
+  if (jobs) args.push("--jobs", String(jobs));
+  return runVault(args);
+}
+
+async function inspectArchive(archivePath, { hideMac = false, output } = {}) {
   const args = [archivePath];
   if (hideMac) args.push("--hide-mac");
+  if (output) args.push("--output", output);
   return runVault(args);
 }
 
+// Decrypted entries as objects ({ vault, registry, key, value, mac }) via --output ndjson.
+async function readEntries(archivePath, { hideMac = false } = {}) {
+  const { stdout } = await inspectArchive(archivePath, { hideMac, output: "ndjson" });
+  return stdout.split("\n").filter(Boolean).map(line => JSON.parse(line));
+}
+
 async function main() {
   const [cmd, ...rest] = process.argv.slice(2);
   if (!cmd || ["-h", "--help"].includes(cmd)) {
-    console.log("Usage:\n  node vault.js compile <in.vau> <out.svau> [--load dep1.svau ...]\n  node vault.js inspect <archive.svau> [--hide-mac]");
+    console.log("Usage:\n  node vault.js compile <in.vau> <out.svau> [--load dep1.svau ...]\n  node vault.js inspect <archive.svau> [--hide-mac] [--output text|json|ndjson|binary]");
     return;
   }
 
@@ -53,7 +119,9 @@ async function main() {
       if (rest.length < 1) throw new Error("inspect requires <archive.svau>");
       const archive = rest[0];
       const hideMac = rest.includes("--hide-mac");
-      const { stdout } = await inspectArchive(archive, { hideMac });
+      const outputAt = rest.indexOf("--output");
+      const output = outputAt >= 0 ? rest[outputAt + 1] : undefined;
+      const { stdout } = await inspectArchive(archive, { hideMac, output });
       process.stdout.write(stdout);
     } else {
       throw new Error(`Unknown command: ${cmd}`);
@@ -68,4 +136,4 @@ if (require.main === module) {
   main();
 }
 
-module.exports = { compileVau, inspectArchive, runVault };
+module.exports = { compileVau, compileStream, compileMany, inspectArchive, readEntries, runVault };
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline unsigned default_jobs() {
+    auto n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Runs fn(i) for every i in [0, count) on up to `jobs` threads. The first exception thrown
+// by any call is rethrown once all workers have stopped.
+template <typename Fn>
+void parallel_for(std::size_t count, unsigned jobs, Fn fn) {
+    if (count == 0) return;
+    auto workers = static_cast<std::size_t>(std::max(1u, jobs));
+    workers = std::min(workers, count);
+    if (workers == 1) {
+        for (std::size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    auto work = [&]() {
+        for (;;) {
+            auto i = next.fetch_add(1);
+            if (i >= count) return;
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                if (!failure) failure = std::current_exception();
+                next = count;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (std::size_t t = 1; t < workers; ++t) threads.emplace_back(work);
+    work();
+    for (auto &t : threads) t.join();
+    if (failure) std::rethrow_exception(failure);
+}
@@ -0,0 +1,271 @@
+#include "query.h"
+
+#include "archive.h"
+#include "archive_index.h"
+#include "config.h"
+#include "crypto.h"
+#include "json.h"
+#include "parallel.h"
+#include "shard.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct QueryOptions {
+    std::string archive;
+    std::optional<std::string> vault;
+    std::string registry;
+    KeyRange range;
+    std::optional<std::string> cursor;
+    std::size_t limit{0}; // 0: no limit
+    bool keysOnly{false};
+    bool ndjson{false};
+};
+
+struct QueryPage {
+    std::string vault;
+    bool sealed{};
+    std::vector<IndexedEntry> entries;
+    bool more{false};
+};
+
+void query_usage() {
+    std::cerr << "Usage: vaultc query <archive.svau> --registry r [--vault v] [--key k | --prefix p | --range from to] [--limit n] [--cursor c] [--keys-only] [--output text|ndjson]\n";
+}
+
+// Cursors are the last key returned, hex-encoded so they survive shells and URLs.
+std::string encode_cursor(const std::string &key) {
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(key.size() * 2);
+    for (unsigned char c : key) {
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 0xF]);
+    }
+    return out;
+}
+
+std::string decode_cursor(const std::string &cursor) {
+    if (cursor.size() % 2 != 0) throw std::runtime_error("Malformed cursor: " + cursor);
+    std::string out;
+    out.reserve(cursor.size() / 2);
+    for (std::size_t i = 0; i < cursor.size(); i += 2) {
+        char *end = nullptr;
+        auto byte = std::strtoul(cursor.substr(i, 2).c_str(), &end, 16);
+        if (!end || *end != '\0') throw std::runtime_error("Malformed cursor: " + cursor);
+        out.push_back(static_cast<char>(byte));
+    }
+    return out;
+}
+
+std::string pick_vault(const std::vector<std::string> &candidates, const QueryOptions &opts) {
+    if (opts.vault) {
+        if (std::find(candidates.begin(), candidates.end(), *opts.vault) == candidates.end()) {
+            throw std::runtime_error("No registry " + opts.registry + " in vault " + *opts.vault);
+        }
+        return *opts.vault;
+    }
+    if (candidates.empty()) throw std::runtime_error("No registry " + opts.registry + " in " + opts.archive);
+    if (candidates.size() > 1) throw std::runtime_error("Registry " + opts.registry + " exists in several vaults; pass --vault");
+    return candidates.front();
+}
+
+// The vault to read and its sealed flag, from the index header alone; scan() checks the flag
+// against the vault's Merkle leaf before any entry is returned.
+QueryPage page_header(const ArchiveIndex &index, const QueryOptions &opts) {
+    auto registries = index.registries();
+    std::vector<std::string> candidates;
+    for (const auto &r : registries) {
+        if (r.registry == opts.registry) candidates.push_back(r.vault);
+    }
+    QueryPage page;
+    page.vault = pick_vault(candidates, opts);
+    for (const auto &r : registries) {
+        if (r.vault == page.vault && r.registry == opts.registry) page.sealed = r.sealed;
+    }
+    return page;
+}
+
+// Binary search through the header index, reading only the page's entry records.
+QueryPage query_indexed(ArchiveIndex &index, const QueryOptions &opts) {
+    auto page = page_header(index, opts);
+    auto limit = opts.limit ? opts.limit + 1 : static_cast<std::size_t>(-1);
+    page.entries = index.scan(page.vault, opts.registry, opts.range, opts.cursor, limit);
+    if (opts.limit && page.entries.size() > opts.limit) {
+        page.entries.resize(opts.limit);
+        page.more = true;
+    }
+    return page;
+}
+
+// Every shard lists every registry, so any one of them names the vault. An exact key is read
+// from the one shard its hash selects (found without a second open when --vault is given);
+// ranges are scanned in all shards at once and the pages merged by key.
+QueryPage query_sharded(const std::string &path, const QueryOptions &opts, const VaultConfig &cfg) {
+    auto manifest = read_shard_manifest(path, cfg);
+    auto shards = manifest.shards.size();
+    bool exact = opts.range.is_exact();
+    std::size_t first = exact && opts.vault ? shard_of(*opts.vault, opts.registry, opts.range.from, shards) : 0;
+    auto index = open_shard_index(manifest, first, cfg);
+    if (exact) {
+        auto target = shard_of(page_header(*index, opts).vault, opts.registry, opts.range.from, shards);
+        if (target != first) index = open_shard_index(manifest, target, cfg);
+        return query_indexed(*index, opts);
+    }
+
+    auto page = page_header(*index, opts);
+    auto limit = opts.limit ? opts.limit + 1 : static_cast<std::size_t>(-1);
+    std::vector<std::vector<IndexedEntry>> found(shards);
+    parallel_for(shards, default_jobs(), [&](std::size_t i) {
+        found[i] = open_shard_index(manifest, i, cfg)->scan(page.vault, opts.registry, opts.range, opts.cursor, limit);
+    });
+    for (auto &entries : found) {
+        page.entries.insert(page.entries.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+    }
+    std::sort(page.entries.begin(), page.entries.end(), [](const IndexedEntry &a, const IndexedEntry &b) { return a.key < b.key; });
+    if (opts.limit && page.entries.size() > opts.limit) {
+        page.entries.resize(opts.limit);
+        page.more = true;
+    }
+    return page;
+}
+
+// Archives without an index, or with appended segments, are read and verified in full.
+QueryPage query_loaded(const LoadedArchive &archive, const QueryOptions &opts) {
+    std::vector<std::string> candidates;
+    for (const auto &v : archive.vaults) {
+        if (v.registries.count(opts.registry)) candidates.push_back(v.name);
+    }
+    candidates = sorted_unique(std::move(candidates));
+    QueryPage page;
+    page.vault = pick_vault(candidates, opts);
+    // the latest record of a repeated vault is the current one
+    auto it = std::find_if(archive.vaults.rbegin(), archive.vaults.rend(), [&](const SealedVault &v) {
+        return v.name == page.vault && v.registries.count(opts.registry);
+    });
+    page.sealed = it->sealed;
+    const auto &entries = it->registries.at(opts.registry)->entries;
+    std::vector<std::string> keys;
+    for (const auto &e : entries) {
+        if (!opts.range.contains(e.first)) continue;
+        if (opts.cursor && e.first <= *opts.cursor) continue;
+        keys.push_back(e.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    if (opts.limit && keys.size() > opts.limit) {
+        keys.resize(opts.limit);
+        page.more = true;
+    }
+    for (const auto &k : keys) {
+        const auto &e = entries.at(k);
+        page.entries.push_back({k, e.digest, e.cipher});
+    }
+    return page;
+}
+
+void print_page(const QueryPage &page, const QueryOptions &opts, const VaultConfig &cfg) {
+    // created outside the scopes below, so it grows on the wiping heap rather than the arena
+    SecureString out;
+    auto &arena = SecureArena::for_thread();
+    for (const auto &e : page.entries) {
+        SecureArena::Scope scope(arena);
+        SecureString value;
+        if (!opts.keysOnly) {
+            value = page.sealed ? crypto::decrypt(e.cipher, cfg.masterKey, opts.registry + ":" + e.key) : SecureString(e.cipher.begin(), e.cipher.end());
+        }
+        if (opts.ndjson) {
+            out += "{\"key\":";
+            append_json_quoted(out, e.key);
+            if (!opts.keysOnly) {
+                out += ",\"value\":";
+                append_json_quoted(out, value);
+            }
+            out += "}\n";
+        } else if (opts.keysOnly) {
+            out += e.key + "\n";
+        } else {
+            out += e.key + " = \"";
+            out += value;
+            out += "\"\n";
+        }
+    }
+    if (page.more) {
+        auto cursor = encode_cursor(page.entries.back().key);
+        if (opts.ndjson) out += "{\"cursor\":\"" + cursor + "\"}\n";
+        else out += "# cursor " + cursor + "\n";
+    }
+    std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+}
+
+int query_main(int argc, char **argv) {
+    QueryOptions opts;
+    bool haveRegistry = false;
+    int selectors = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--vault" && i + 1 < argc) {
+            opts.vault = argv[++i];
+        } else if (arg == "--registry" && i + 1 < argc) {
+            opts.registry = argv[++i];
+            haveRegistry = true;
+        } else if (arg == "--key" && i + 1 < argc) {
+            opts.range = KeyRange::exact(argv[++i]);
+            selectors++;
+        } else if (arg == "--prefix" && i + 1 < argc) {
+            opts.range = KeyRange::prefix(argv[++i]);
+            selectors++;
+        } else if (arg == "--range" && i + 2 < argc) {
+            opts.range.from = argv[++i];
+            opts.range.to = std::string(argv[++i]);
+            selectors++;
+        } else if (arg == "--limit" && i + 1 < argc) {
+            opts.limit = static_cast<std::size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--cursor" && i + 1 < argc) {
+            opts.cursor = std::string(argv[++i]);
+        } else if (arg == "--keys-only") {
+            opts.keysOnly = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "text" && format != "ndjson") {
+                query_usage();
+                return 1;
+            }
+            opts.ndjson = format == "ndjson";
+        } else if (!arg.empty() && arg[0] != '-' && opts.archive.empty()) {
+            opts.archive = arg;
+        } else {
+            query_usage();
+            return 1;
+        }
+    }
+    if (opts.archive.empty() || !haveRegistry || selectors > 1) {
+        query_usage();
+        return 1;
+    }
+
+    try {
+        if (opts.cursor) opts.cursor = decode_cursor(*opts.cursor);
+        auto cfg = load_config(false);
+        QueryPage page;
+        if (is_shard_manifest(opts.archive)) {
+            page = query_sharded(opts.archive, opts, cfg);
+        } else if (ArchiveIndex index(opts.archive, cfg.token, cfg.masterKey); index.usable()) {
+            page = query_indexed(index, opts);
+        } else {
+            page = query_loaded(open_archive(opts.archive, cfg), opts);
+        }
+        print_page(page, opts, cfg);
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// `vaultc query`: exact, prefix and range lookups over one registry of an archive through its
+// sorted key index, paged with a resumable cursor. argv[0] is "query".
+int query_main(int argc, char **argv);
@@ -0,0 +1,266 @@
+#include "rekey.h"
+
+#include "archive.h"
+#include "config.h"
+#include "crypto.h"
+#include "parallel.h"
+#include "shard.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct RekeyOptions {
+    std::string input;
+    std::string output;
+    std::optional<std::string> oldKeyEnv;
+    std::string newKeyEnv;
+    unsigned jobs{default_jobs()};
+    std::size_t batch{4096};
+    bool deterministic{false};
+    bool verbose{false};
+};
+
+struct RekeyStats {
+    std::size_t entries{};
+    std::uintmax_t bytes{};
+};
+
+void rekey_usage() {
+    std::cerr << "Usage: vaultc rekey <in.svau> <out.svau> --new-key-env NAME [--old-key-env NAME] [--jobs n] [--batch n] [--deterministic] [--verbose]\n";
+    std::cerr << "The old key defaults to MASTER_KEY from .vault/var.vc.\n";
+}
+
+WipedString key_from_env(const std::string &name) {
+    const char *value = std::getenv(name.c_str());
+    if (!value || !*value) throw std::runtime_error("Environment variable " + name + " is not set");
+    WipedString key = std::string(value);
+    if (key.str().size() % 2 != 0 || key.str().find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+        throw std::runtime_error("Environment variable " + name + " is not a hex key");
+    }
+    return key;
+}
+
+// Values are decrypted under the old key and encrypted under the new one with the same
+// registry:key binding, then the digest is re-MACed under the new key. Open vaults are no
+// exception: the interpreter seals every value it stores whether or not the vault is secured.
+void rekey_entry(SealedEntry &entry, const std::string &salt, const std::string &oldKey, const std::string &newKey, bool deterministic) {
+    // runs on pool threads: each has its own arena, rewound and wiped per entry
+    SecureArena::Scope scope(SecureArena::for_thread());
+    auto plain = crypto::decrypt(entry.cipher, oldKey, salt);
+    entry.cipher = deterministic ? crypto::encrypt_deterministic(plain, newKey, salt) : crypto::encrypt(plain, newKey, salt);
+    entry.digest = crypto::digest(entry.cipher, newKey);
+}
+
+// One parsed piece of the input's records, replayed into a RecordWriter in order once its
+// batch of entries has been re-encrypted.
+struct RecordEvent {
+    enum class Kind { Vault, Registry, Entry, EndVault };
+    Kind kind{};
+    std::string name;
+    bool optional{};
+    bool sealed{};
+    std::string salt;
+    SealedEntry entry;
+};
+
+// Bare archives (no appended segments) are streamed: records are read, re-encrypted a batch at
+// a time on `jobs` threads and handed to a StreamedArchiveWriter while the input's MAC is
+// recomputed. Memory holds one batch plus the per-registry layout, not the values.
+RekeyStats rekey_stream(const RekeyOptions &opts, const VaultConfig &cfg, const std::string &oldKey, const std::string &newKey) {
+    std::ifstream in(opts.input, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + opts.input);
+
+    std::vector<std::string> deps;
+    std::string line;
+    bool haveRecord = false;
+    while (std::getline(in, line)) {
+        if (line.rfind("depends ", 0) == 0) { deps.push_back(line.substr(8)); continue; }
+        if (line.rfind("token ", 0) == 0) {
+            if (line.substr(6) != cfg.token) throw std::runtime_error("Token mismatch for archive: " + opts.input);
+            continue;
+        }
+        if (line.rfind("index-end ", 0) == 0) { in.ignore(std::stoll(line.substr(10))); continue; }
+        if (line.rfind("vault ", 0) == 0 || line.rfind("hmac ", 0) == 0) { haveRecord = true; break; }
+    }
+    deps = sorted_unique(std::move(deps));
+    auto recordsBase = haveRecord ? static_cast<std::uint64_t>(in.tellg()) - line.size() - 1 : 0;
+    std::ifstream refs; // second handle for resolving cipher references
+
+    crypto::Hmac oldMac(oldKey);
+    oldMac.update(archive_mac_preamble(cfg.token, deps));
+    StreamedArchiveWriter output(opts.output, cfg.token, newKey, deps);
+    auto &writer = output.records();
+
+    RekeyStats stats;
+    std::vector<RecordEvent> events;
+    std::vector<std::size_t> entryEvents;
+    auto flush = [&]() {
+        parallel_for(entryEvents.size(), opts.jobs, [&](std::size_t i) {
+            auto &e = events[entryEvents[i]];
+            rekey_entry(e.entry, e.salt, oldKey, newKey, opts.deterministic);
+        });
+        for (const auto &e : events) {
+            switch (e.kind) {
+            case RecordEvent::Kind::Vault: writer.begin_vault(e.name, e.optional, e.sealed); break;
+            case RecordEvent::Kind::Registry: writer.begin_registry(e.name); break;
+            case RecordEvent::Kind::Entry: writer.entry(e.name, e.entry.digest, e.entry.cipher); break;
+            case RecordEvent::Kind::EndVault: writer.end_vault(); break;
+            }
+        }
+        stats.entries += entryEvents.size();
+        events.clear();
+        entryEvents.clear();
+    };
+
+    std::string hmac;
+    RecordEvent vault;
+    std::string registry;
+    RecordEvent pending;
+    // `line` already holds the first record line (or the trailer) when haveRecord is set
+    for (bool more = haveRecord; more; more = static_cast<bool>(std::getline(in, line))) {
+        if (line.rfind("hmac ", 0) == 0) {
+            hmac = line.substr(5);
+            break;
+        }
+        if (line.rfind("      cipher @", 0) == 0) {
+            if (!refs.is_open()) refs.open(opts.input, std::ios::binary);
+            line = "      cipher " + resolve_cipher_ref(refs, recordsBase, line.substr(13));
+        }
+        oldMac.update(line + "\n");
+        if (line.rfind("vault ", 0) == 0) {
+            vault = RecordEvent{};
+            vault.kind = RecordEvent::Kind::Vault;
+            vault.name = line.substr(6, line.find(' ', 6) - 6);
+            vault.optional = line.find("(optional)") != std::string::npos;
+        } else if (line.rfind("sealed ", 0) == 0) {
+            vault.sealed = line == "sealed true";
+            events.push_back(vault);
+        } else if (line.rfind("  registry ", 0) == 0) {
+            registry = line.substr(11);
+            RecordEvent e;
+            e.kind = RecordEvent::Kind::Registry;
+            e.name = registry;
+            events.push_back(std::move(e));
+        } else if (line.rfind("    entry ", 0) == 0) {
+            pending = RecordEvent{};
+            pending.kind = RecordEvent::Kind::Entry;
+            pending.name = line.substr(10);
+        } else if (line.rfind("      digest ", 0) == 0) {
+            pending.entry.digest = line.substr(13);
+        } else if (line.rfind("      cipher ", 0) == 0) {
+            pending.entry.cipher = line.substr(13);
+            pending.salt = registry + ":" + pending.name;
+            entryEvents.push_back(events.size());
+            events.push_back(std::move(pending));
+            if (entryEvents.size() >= opts.batch) flush();
+        } else if (line == "---") {
+            RecordEvent e;
+            e.kind = RecordEvent::Kind::EndVault;
+            events.push_back(std::move(e));
+        } else if (line.rfind("segment", 0) == 0) {
+            throw std::runtime_error("Unexpected segment in " + opts.input);
+        }
+    }
+    flush();
+    if (!hmac.empty() && oldMac.final() != hmac) {
+        throw std::runtime_error("Archive HMAC verification failed: " + opts.input);
+    }
+    stats.bytes = output.commit();
+    return stats;
+}
+
+// Archives with appended segments are replayed in memory and written back as one base; sharded
+// archives are merged the same way and written back with their shard count.
+RekeyStats rekey_loaded(const RekeyOptions &opts, VaultConfig cfg, const std::string &oldKey, const std::string &newKey) {
+    cfg.masterKey = oldKey;
+    std::size_t shards = is_shard_manifest(opts.input) ? read_shard_manifest(opts.input, cfg).shards.size() : 0;
+    auto archive = open_archive(opts.input, cfg);
+    struct Job {
+        SealedEntry *entry;
+        std::string salt;
+    };
+    std::vector<Job> jobs;
+    for (auto &v : archive.vaults) {
+        v.masterKeyHex = newKey;
+        for (auto &regPair : v.registries) {
+            auto &reg = regPair.second.write();
+            reg.filter.reset();
+            for (auto &entryPair : reg.entries) jobs.push_back({&entryPair.second, regPair.first + ":" + entryPair.first});
+        }
+    }
+    parallel_for(jobs.size(), opts.jobs, [&](std::size_t i) {
+        rekey_entry(*jobs[i].entry, jobs[i].salt, oldKey, newKey, opts.deterministic);
+    });
+    RekeyStats stats;
+    stats.entries = jobs.size();
+    if (shards) {
+        write_sharded_file(opts.output, archive.vaults, cfg.token, newKey, archive.dependencies, shards);
+        for (std::size_t i = 0; i < shards; ++i) stats.bytes += std::filesystem::file_size(shard_path(opts.output, i));
+        return stats;
+    }
+    auto hmac = compute_archive_hmac(archive.vaults, cfg.token, newKey, archive.dependencies);
+    write_svau_file(opts.output, archive.vaults, cfg.token, newKey, archive.dependencies, hmac);
+    stats.bytes = std::filesystem::file_size(opts.output);
+    return stats;
+}
+}
+
+int rekey_main(int argc, char **argv) {
+    RekeyOptions opts;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--old-key-env" && i + 1 < argc) {
+            opts.oldKeyEnv = argv[++i];
+        } else if (arg == "--new-key-env" && i + 1 < argc) {
+            opts.newKeyEnv = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--batch" && i + 1 < argc) {
+            opts.batch = static_cast<std::size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--deterministic") {
+            opts.deterministic = true;
+        } else if (arg == "--verbose") {
+            opts.verbose = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            rekey_usage();
+            return 1;
+        }
+    }
+    if (paths.size() != 2 || opts.newKeyEnv.empty()) {
+        rekey_usage();
+        return 1;
+    }
+    opts.input = paths[0];
+    opts.output = paths[1];
+
+    auto started = std::chrono::steady_clock::now();
+    try {
+        auto cfg = load_config(false);
+        auto oldKey = opts.oldKeyEnv ? key_from_env(*opts.oldKeyEnv) : WipedString(cfg.masterKey);
+        auto newKey = key_from_env(opts.newKeyEnv);
+        bool sharded = is_shard_manifest(opts.input);
+        bool streamed = !sharded && !archive_has_segments(opts.input);
+        auto stats = streamed ? rekey_stream(opts, cfg, oldKey, newKey) : rekey_loaded(opts, cfg, oldKey, newKey);
+        if (opts.verbose) {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+            std::cout << "rekeyed " << stats.entries << " entries (" << stats.bytes << " bytes" << (sharded ? ", sharded" : streamed ? "" : ", segments folded")
+                      << ") into " << opts.output << " in " << ms << " ms\n";
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// `vaultc rekey`: re-encrypts an archive under a new master key. argv[0] is "rekey".
+int rekey_main(int argc, char **argv);
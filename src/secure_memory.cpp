@@ -0,0 +1,151 @@
+#include "secure_memory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+thread_local SecureArena *currentArena = nullptr;
+
+std::size_t page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    auto n = sysconf(_SC_PAGESIZE);
+    return n > 0 ? static_cast<std::size_t>(n) : 4096;
+#endif
+}
+
+// Page-aligned, zero-filled memory, locked if the process may lock it.
+char *map_pages(std::size_t size, bool &locked) {
+#ifdef _WIN32
+    auto *p = static_cast<char *>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+    if (!p) throw std::bad_alloc();
+    locked = VirtualLock(p, size) != 0;
+#else
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    locked = mlock(p, size) == 0;
+#ifdef MADV_DONTDUMP
+    madvise(p, size, MADV_DONTDUMP);
+#endif
+#endif
+    return static_cast<char *>(p);
+}
+
+void unmap_pages(char *p, std::size_t size, bool locked) {
+    secure_zero(p, size);
+#ifdef _WIN32
+    if (locked) VirtualUnlock(p, size);
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    if (locked) munlock(p, size);
+    munmap(p, size);
+#endif
+}
+}
+
+void secure_zero(void *p, std::size_t n) noexcept {
+    if (!p || n == 0) return;
+#ifdef _WIN32
+    SecureZeroMemory(p, n);
+#elif defined(__GNUC__)
+    std::memset(p, 0, n);
+    // the memory is treated as read afterwards, so the memset cannot be dropped
+    __asm__ __volatile__("" : : "r"(p) : "memory");
+#else
+    auto *v = static_cast<volatile unsigned char *>(p);
+    while (n--) *v++ = 0;
+#endif
+}
+
+void secure_wipe(std::string &s) noexcept {
+    s.resize(s.capacity());
+    secure_zero(&s[0], s.size());
+    s.clear();
+}
+
+SecureArena::SecureArena(std::size_t chunkBytes) : chunkBytes_(chunkBytes) {}
+
+SecureArena::~SecureArena() {
+    if (currentArena == this) currentArena = nullptr;
+    for (auto &c : chunks_) unmap_pages(c.base, c.size, c.locked);
+}
+
+void SecureArena::grow(std::size_t bytes) {
+    auto page = page_size();
+    auto size = (std::max(bytes, chunkBytes_) + page - 1) / page * page;
+    Chunk c;
+    c.base = map_pages(size, c.locked);
+    c.size = size;
+    chunks_.push_back(c);
+}
+
+void *SecureArena::allocate(std::size_t bytes, std::size_t align) {
+    if (bytes == 0) bytes = 1;
+    for (;;) {
+        for (; active_ < chunks_.size(); ++active_) {
+            auto &c = chunks_[active_];
+            auto start = (c.used + align - 1) / align * align;
+            if (start + bytes <= c.size) {
+                c.used = start + bytes;
+                return c.base + start;
+            }
+        }
+        grow(bytes + align);
+        active_ = chunks_.size() - 1;
+    }
+}
+
+void SecureArena::deallocate(void *p, std::size_t bytes) noexcept {
+    secure_zero(p, bytes);
+    if (active_ >= chunks_.size()) return;
+    auto &c = chunks_[active_];
+    auto *block = static_cast<char *>(p);
+    if (block >= c.base && block + bytes == c.base + c.used) c.used = static_cast<std::size_t>(block - c.base);
+}
+
+void SecureArena::reset() noexcept {
+    for (std::size_t i = 0; i < chunks_.size() && i <= active_; ++i) {
+        secure_zero(chunks_[i].base, chunks_[i].used);
+        chunks_[i].used = 0;
+    }
+    active_ = 0;
+}
+
+SecureArena &SecureArena::for_thread() {
+    thread_local SecureArena arena;
+    return arena;
+}
+
+SecureArena *SecureArena::current() noexcept {
+    return currentArena;
+}
+
+SecureArena::Scope::Scope(SecureArena &arena) noexcept : arena_(arena), previous_(currentArena) {
+    currentArena = &arena;
+    arena_.depth_++;
+}
+
+SecureArena::Scope::~Scope() {
+    currentArena = previous_;
+    if (--arena_.depth_ == 0) arena_.reset();
+}
+
+void *secure_heap_allocate(std::size_t bytes) {
+    return ::operator new(bytes == 0 ? 1 : bytes);
+}
+
+void secure_heap_free(void *p, std::size_t bytes) noexcept {
+    secure_zero(p, bytes);
+    ::operator delete(p);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Wipes n bytes at p in a way the compiler may not elide.
+void secure_zero(void *p, std::size_t n) noexcept;
+// Wipes a std::string's whole buffer, then empties it; for secrets that must stay std::string.
+void secure_wipe(std::string &s) noexcept;
+
+// Bump allocator over page-locked memory for short-lived secrets: plaintexts and decoded key
+// bytes. Chunks are locked with mlock/VirtualLock where the process is allowed to (if not, the
+// memory is still wiped) and kept out of core dumps where the platform supports it. A freed
+// block is wiped at once and its space reused if it was the last allocation; reset() wipes
+// everything handed out and rewinds, keeping the chunks for the next batch. Not thread-safe;
+// each thread has its own (for_thread()).
+class SecureArena {
+  public:
+    explicit SecureArena(std::size_t chunkBytes = 64 * 1024);
+    ~SecureArena();
+    SecureArena(const SecureArena &) = delete;
+    SecureArena &operator=(const SecureArena &) = delete;
+
+    void *allocate(std::size_t bytes, std::size_t align);
+    void deallocate(void *p, std::size_t bytes) noexcept;
+    void reset() noexcept;
+
+    static SecureArena &for_thread();
+    // The arena SecureAllocator draws from on this thread; null outside any Scope.
+    static SecureArena *current() noexcept;
+
+    // Makes `arena` current on this thread while it lives. The outermost scope of an arena
+    // resets it on exit, so secure strings allocated inside must not outlive the scope.
+    class Scope {
+      public:
+        explicit Scope(SecureArena &arena) noexcept;
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+      private:
+        SecureArena &arena_;
+        SecureArena *previous_;
+    };
+
+  private:
+    struct Chunk {
+        char *base{};
+        std::size_t size{};
+        std::size_t used{};
+        bool locked{};
+    };
+
+    void grow(std::size_t bytes);
+
+    std::size_t chunkBytes_;
+    std::vector<Chunk> chunks_;
+    std::size_t active_{}; // chunk allocations currently bump from; later ones are empty
+    int depth_{};
+};
+
+// Outside an arena scope, secure containers use the ordinary heap and wipe blocks on free.
+void *secure_heap_allocate(std::size_t bytes);
+void secure_heap_free(void *p, std::size_t bytes) noexcept;
+
+// Allocator for secret-holding containers: from the arena current when the container was
+// created, otherwise from the wiping heap. Strings short enough for the small-string buffer
+// never allocate and are not covered.
+template <typename T>
+class SecureAllocator {
+  public:
+    using value_type = T;
+
+    SecureAllocator() noexcept : arena_(SecureArena::current()) {}
+    explicit SecureAllocator(SecureArena *arena) noexcept : arena_(arena) {}
+    template <typename U>
+    SecureAllocator(const SecureAllocator<U> &other) noexcept : arena_(other.arena()) {}
+
+    T *allocate(std::size_t n) {
+        auto bytes = n * sizeof(T);
+        return static_cast<T *>(arena_ ? arena_->allocate(bytes, alignof(T)) : secure_heap_allocate(bytes));
+    }
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (arena_) arena_->deallocate(p, n * sizeof(T));
+        else secure_heap_free(p, n * sizeof(T));
+    }
+
+    SecureArena *arena() const noexcept { return arena_; }
+
+  private:
+    SecureArena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const SecureAllocator<T> &a, const SecureAllocator<U> &b) noexcept {
+    return a.arena() == b.arena();
+}
+template <typename T, typename U>
+bool operator!=(const SecureAllocator<T> &a, const SecureAllocator<U> &b) noexcept {
+    return !(a == b);
+}
+
+using SecureString = std::basic_string<char, std::char_traits<char>, SecureAllocator<char>>;
+using SecureBytes = std::vector<std::uint8_t, SecureAllocator<std::uint8_t>>;
+
+// A key kept in a copyable record (a vault, an index, an options struct): an ordinary string
+// whose buffer is wiped when it is destroyed, overwritten or moved from. Reads go through the
+// const std::string conversion, so it passes wherever a key parameter is expected.
+class WipedString {
+  public:
+    WipedString() = default;
+    WipedString(std::string s) noexcept : s_(std::move(s)) {}
+    WipedString(const WipedString &other) : s_(other.s_) {}
+    WipedString(WipedString &&other) noexcept : s_(std::move(other.s_)) { secure_wipe(other.s_); }
+    WipedString &operator=(WipedString other) noexcept {
+        secure_wipe(s_);
+        s_.swap(other.s_);
+        return *this;
+    }
+    ~WipedString() { secure_wipe(s_); }
+
+    operator const std::string &() const noexcept { return s_; }
+    const std::string &str() const noexcept { return s_; }
+    bool empty() const noexcept { return s_.empty(); }
+
+    friend bool operator==(const WipedString &a, const WipedString &b) { return a.s_ == b.s_; }
+    friend bool operator!=(const WipedString &a, const WipedString &b) { return a.s_ != b.s_; }
+
+  private:
+    std::string s_;
+};
@@ -0,0 +1,107 @@
+#include "seed.h"
+
+#include "config.h"
+#include "crypto.h"
+#include "parallel.h"
+
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+const char *conflict_name(SeedConflict conflict) {
+    switch (conflict) {
+    case SeedConflict::First: return "first";
+    case SeedConflict::Last: return "last";
+    default: return "error";
+    }
+}
+
+// The latest record of each vault in one archive, in order of first appearance.
+std::vector<const SealedVault *> latest_records(const LoadedArchive &archive) {
+    std::vector<const SealedVault *> out;
+    std::unordered_map<std::string, std::size_t> at;
+    for (const auto &v : archive.vaults) {
+        auto inserted = at.emplace(v.name, out.size());
+        if (inserted.second) out.push_back(&v); else out[inserted.first->second] = &v;
+    }
+    return out;
+}
+
+void merge_vault(SealedVault &into, const SealedVault &from, SeedConflict conflict, const std::string &path) {
+    if (into.masterKeyHex != from.masterKeyHex) {
+        throw std::runtime_error("Master key mismatch for vault '" + from.name + "' in " + path);
+    }
+    if (conflict == SeedConflict::Last) {
+        into.optional = from.optional;
+        into.sealed = from.sealed;
+    }
+    for (const auto &regPair : from.registries) {
+        auto found = into.registries.find(regPair.first);
+        if (found == into.registries.end()) {
+            into.registries.emplace(regPair.first, regPair.second);
+            continue;
+        }
+        auto &reg = found->second.write();
+        for (const auto &entry : regPair.second->entries) {
+            auto inserted = reg.entries.insert(entry);
+            if (inserted.second || inserted.first->second.digest == entry.second.digest) continue;
+            if (conflict == SeedConflict::Error) {
+                throw std::runtime_error("Seed archives disagree on " + from.name + "/" + regPair.first + "/" + entry.first + " (" + path +
+                                         " and an earlier --load); pass --load-conflict first|last");
+            }
+            if (conflict == SeedConflict::Last) inserted.first->second = entry.second;
+        }
+        // the filter described one archive's keys
+        reg.filter.reset();
+    }
+}
+}
+
+bool parse_seed_conflict(const std::string &name, SeedConflict &out) {
+    if (name == "error") out = SeedConflict::Error;
+    else if (name == "first") out = SeedConflict::First;
+    else if (name == "last") out = SeedConflict::Last;
+    else return false;
+    return true;
+}
+
+LoadedArchive merge_seeds(const std::vector<const LoadedArchive *> &archives, const std::vector<std::string> &paths,
+                          SeedConflict conflict, const std::string &token, const std::string &masterKeyHex) {
+    if (archives.size() == 1) return *archives[0];
+    LoadedArchive merged;
+    merged.token = token;
+    std::unordered_map<std::string, std::size_t> at;
+    std::string material = std::string("seeds ") + conflict_name(conflict) + "\n";
+    for (std::size_t i = 0; i < archives.size(); ++i) {
+        const auto &archive = *archives[i];
+        material += content_hmac(archive, token, masterKeyHex) + "\n";
+        merged.dependencies.insert(merged.dependencies.end(), archive.dependencies.begin(), archive.dependencies.end());
+        for (const auto *v : latest_records(archive)) {
+            auto inserted = at.emplace(v->name, merged.vaults.size());
+            if (inserted.second) merged.vaults.push_back(*v);
+            else merge_vault(merged.vaults[inserted.first->second], *v, conflict, paths[i]);
+        }
+    }
+    merged.dependencies = sorted_unique(std::move(merged.dependencies));
+    merged.hmac = crypto::digest(material, masterKeyHex);
+    return merged;
+}
+
+LoadedArchive open_seeds(const std::vector<std::string> &paths, const VaultConfig &cfg, SeedConflict conflict) {
+    std::vector<LoadedArchive> loaded(paths.size());
+    parallel_for(paths.size(), default_jobs(), [&](std::size_t i) { loaded[i] = open_archive(paths[i], cfg); });
+    if (loaded.size() == 1) return std::move(loaded[0]);
+    std::vector<const LoadedArchive *> archives;
+    for (const auto &a : loaded) archives.push_back(&a);
+    return merge_seeds(archives, paths, conflict, cfg.token, cfg.masterKey);
+}
+
+std::vector<std::string> seed_dependencies(const LoadedArchive &seed, const std::vector<std::string> &paths) {
+    auto deps = seed.dependencies;
+    for (const auto &p : paths) deps.push_back(std::filesystem::path(p).filename().string());
+    return sorted_unique(std::move(deps));
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "archive.h"
+
+#include <string>
+#include <vector>
+
+struct VaultConfig;
+
+// How repeated --load archives settle a key that two of them hold with different digests.
+enum class SeedConflict { Error, First, Last };
+
+bool parse_seed_conflict(const std::string &name, SeedConflict &out);
+
+// One seed from several --load archives, in command-line order. A single archive is returned
+// as it is. Otherwise each vault becomes one record holding the union of its latest record in
+// every archive; a key held with different digests is a conflict settled by `conflict`, which
+// also picks whose optional/sealed flags win. The merged view has no segments, its
+// dependencies are the union of the archives', and its hmac is a MAC over their content MACs
+// (see content_hmac), so caches keyed on it change whenever any seed does.
+LoadedArchive merge_seeds(const std::vector<const LoadedArchive *> &archives, const std::vector<std::string> &paths,
+                          SeedConflict conflict, const std::string &token, const std::string &masterKeyHex);
+// Opens and verifies the archives in parallel on default_jobs() threads, then merges them.
+LoadedArchive open_seeds(const std::vector<std::string> &paths, const VaultConfig &cfg, SeedConflict conflict);
+// What an archive compiled against `seed` depends on: its dependencies plus each seed file.
+std::vector<std::string> seed_dependencies(const LoadedArchive &seed, const std::vector<std::string> &paths);
@@ -0,0 +1,201 @@
+#include "shard.h"
+
+#include "bloom.h"
+#include "config.h"
+#include "crypto.h"
+#include "parallel.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+const char kManifestMagic[] = "# Vault Shard Manifest";
+
+std::string manifest_mac(const std::string &token, const std::string &masterKeyHex, const std::vector<std::string> &dependencies,
+                         const std::string &shardLines) {
+    return crypto::digest(archive_mac_preamble(token, dependencies) + shardLines, masterKeyHex);
+}
+
+// Every shard gets every vault record and registry name, and the entries that hash to it.
+std::vector<std::vector<SealedVault>> split_vaults(const std::vector<SealedVault> &vaults, std::size_t shards) {
+    std::vector<std::vector<SealedVault>> parts(shards);
+    for (const auto &v : vaults) {
+        for (auto &part : parts) {
+            SealedVault copy;
+            copy.name = v.name;
+            copy.optional = v.optional;
+            copy.sealed = v.sealed;
+            copy.masterKeyHex = v.masterKeyHex;
+            for (const auto &regPair : v.registries) copy.registries[regPair.first] = Cow<SealedRegistry>();
+            part.push_back(std::move(copy));
+        }
+        for (const auto &regPair : v.registries) {
+            for (const auto &entry : regPair.second->entries) {
+                auto &part = parts[shard_of(v.name, regPair.first, entry.first, shards)];
+                part.back().registries[regPair.first].write().entries.insert(entry);
+            }
+        }
+    }
+    return parts;
+}
+
+// `shard <i> <file> <hmac> <merkle>`; the file name may contain spaces.
+ShardManifest::Shard parse_shard_line(const std::string &line, const std::filesystem::path &dir, std::size_t expected) {
+    auto first = line.find(' ', 6);
+    auto last = line.rfind(' ');
+    auto second = last == std::string::npos || last == 0 ? std::string::npos : line.rfind(' ', last - 1);
+    if (first == std::string::npos || second == std::string::npos || second <= first) {
+        throw std::runtime_error("Malformed shard line: " + line);
+    }
+    if (line.substr(6, first - 6) != std::to_string(expected)) throw std::runtime_error("Shard out of order: " + line);
+    ShardManifest::Shard shard;
+    shard.path = (dir / line.substr(first + 1, second - first - 1)).string();
+    shard.hmac = line.substr(second + 1, last - second - 1);
+    shard.merkle = line.substr(last + 1);
+    return shard;
+}
+}
+
+bool is_shard_manifest(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string line;
+    return in && std::getline(in, line) && line == kManifestMagic;
+}
+
+std::size_t shard_of(const std::string &vault, const std::string &registry, const std::string &key, std::size_t shards) {
+    std::string material;
+    material.reserve(vault.size() + registry.size() + key.size() + 2);
+    material += vault;
+    material.push_back('\0');
+    material += registry;
+    material.push_back('\0');
+    material += key;
+    return static_cast<std::size_t>(BloomFilter::hash(material) % shards);
+}
+
+std::string shard_path(const std::string &manifestPath, std::size_t index) {
+    std::filesystem::path p(manifestPath);
+    return (p.parent_path() / (p.stem().string() + ".shard-" + std::to_string(index) + ".svau")).string();
+}
+
+ShardManifest read_shard_manifest(const std::string &path, const VaultConfig &cfg) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Unable to read: " + path);
+    std::string line;
+    if (!std::getline(in, line) || line != kManifestMagic) throw std::runtime_error("Not a shard manifest: " + path);
+    auto dir = std::filesystem::path(path).parent_path();
+    ShardManifest manifest;
+    std::string shardLines;
+    std::size_t declared = 0;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        if (line.rfind("depends ", 0) == 0) {
+            manifest.dependencies.push_back(line.substr(8));
+        } else if (line.rfind("shards ", 0) == 0) {
+            declared = std::stoull(line.substr(7));
+            shardLines += line + "\n";
+        } else if (line.rfind("shard ", 0) == 0) {
+            manifest.shards.push_back(parse_shard_line(line, dir, manifest.shards.size()));
+            shardLines += line + "\n";
+        } else if (line.rfind("hmac ", 0) == 0) {
+            manifest.hmac = line.substr(5);
+        } else {
+            throw std::runtime_error("Malformed shard manifest line in " + path + ": " + line);
+        }
+    }
+    if (manifest.hmac.empty() || declared == 0 || declared != manifest.shards.size()) {
+        throw std::runtime_error("Incomplete shard manifest: " + path);
+    }
+    if (manifest_mac(cfg.token, cfg.masterKey, manifest.dependencies, shardLines) != manifest.hmac) {
+        throw std::runtime_error("Shard manifest HMAC verification failed: " + path);
+    }
+    return manifest;
+}
+
+LoadedArchive open_sharded(const std::string &path, const VaultConfig &cfg) {
+    auto manifest = read_shard_manifest(path, cfg);
+    std::vector<LoadedArchive> parts(manifest.shards.size());
+    parallel_for(parts.size(), default_jobs(), [&](std::size_t i) {
+        const auto &shard = manifest.shards[i];
+        if (is_shard_manifest(shard.path)) throw std::runtime_error("Shard is itself a manifest: " + shard.path);
+        parts[i] = open_archive(shard.path, cfg);
+        // appending to a shard would change its view without the manifest knowing
+        if (!parts[i].segments.empty() || parts[i].hmac != shard.hmac) {
+            throw std::runtime_error("Shard does not match manifest " + path + ": " + shard.path);
+        }
+    });
+
+    LoadedArchive merged;
+    merged.hmac = manifest.hmac;
+    merged.dependencies = manifest.dependencies;
+    merged.vaults = std::move(parts[0].vaults);
+    for (std::size_t i = 1; i < parts.size(); ++i) {
+        auto &vaults = parts[i].vaults;
+        if (vaults.size() != merged.vaults.size()) throw std::runtime_error("Shards of " + path + " hold different vault records");
+        for (std::size_t r = 0; r < vaults.size(); ++r) {
+            auto &into = merged.vaults[r];
+            auto &from = vaults[r];
+            if (from.name != into.name || from.optional != into.optional || from.sealed != into.sealed) {
+                throw std::runtime_error("Shards of " + path + " disagree on vault " + into.name);
+            }
+            for (auto &regPair : from.registries) {
+                into.registries[regPair.first].write().entries.merge(regPair.second.write().entries);
+            }
+        }
+    }
+    // each filter covers one shard's keys only
+    for (auto &v : merged.vaults) {
+        for (auto &regPair : v.registries) {
+            if (regPair.second->filter) regPair.second.write().filter.reset();
+        }
+    }
+    return merged;
+}
+
+std::unique_ptr<ArchiveIndex> open_shard_index(const ShardManifest &manifest, std::size_t index, const VaultConfig &cfg) {
+    const auto &shard = manifest.shards.at(index);
+    auto shardIndex = std::make_unique<ArchiveIndex>(shard.path, cfg.token, cfg.masterKey);
+    if (!shardIndex->usable() || shardIndex->root_mac() != shard.merkle) {
+        throw std::runtime_error("Shard does not match its manifest: " + shard.path);
+    }
+    return shardIndex;
+}
+
+void add_sharded(ArchiveBatch &batch, const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                 const std::string &masterKeyHex, const std::vector<std::string> &dependencies, std::size_t shards) {
+    if (shards == 0) throw std::runtime_error("--shards must be at least 1");
+    auto parts = split_vaults(vaults, shards);
+    auto deps = sorted_unique(dependencies);
+    std::vector<std::string> hmacs(shards);
+    std::vector<std::string> merkles(shards);
+    parallel_for(shards, default_jobs(), [&](std::size_t i) {
+        hmacs[i] = compute_archive_hmac(parts[i], token, masterKeyHex, deps);
+        batch.add_with(shard_path(outPath, i), [&](std::ostream &out) {
+            merkles[i] = write_svau(out, parts[i], token, masterKeyHex, deps);
+            out << "hmac " << hmacs[i] << "\n";
+        });
+    });
+
+    std::string shardLines = "shards " + std::to_string(shards) + "\n";
+    for (std::size_t i = 0; i < shards; ++i) {
+        auto file = std::filesystem::path(shard_path(outPath, i)).filename().string();
+        shardLines += "shard " + std::to_string(i) + " " + file + " " + hmacs[i] + " " + merkles[i] + "\n";
+    }
+    batch.add_with(outPath, [&](std::ostream &out) {
+        out << kManifestMagic << "\n";
+        for (const auto &d : deps) out << "depends " << d << "\n";
+        out << shardLines;
+        out << "hmac " << manifest_mac(token, masterKeyHex, deps, shardLines) << "\n";
+    });
+}
+
+void write_sharded_file(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                        const std::string &masterKeyHex, const std::vector<std::string> &dependencies, std::size_t shards) {
+    ArchiveBatch batch;
+    add_sharded(batch, outPath, vaults, token, masterKeyHex, dependencies, shards);
+    batch.commit();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "archive.h"
+#include "archive_index.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct VaultConfig;
+
+// Sharded archives: the output path holds a small manifest and the entries live in N ordinary
+// archives next to it (`<stem>.shard-<i>.svau`), partitioned by a hash of vault, registry and
+// key. Every shard carries every vault record and registry name, with its own index, Merkle
+// tree and hmac, so each can be verified and searched alone; the manifest lists each shard's
+// hmac and Merkle root MAC under its own MAC, which binds the set together.
+//
+//   # Vault Shard Manifest
+//   depends <archive>
+//   shards <n>
+//   shard <i> <file> <hmac> <merkle root mac>
+//   hmac <mac over token, depends and the shard lines>
+struct ShardManifest {
+    struct Shard {
+        std::string path; // resolved against the manifest's directory
+        std::string hmac;
+        std::string merkle;
+    };
+    std::vector<std::string> dependencies;
+    std::vector<Shard> shards;
+    std::string hmac;
+};
+
+bool is_shard_manifest(const std::string &path);
+// Which of `shards` holds vault/registry/key.
+std::size_t shard_of(const std::string &vault, const std::string &registry, const std::string &key, std::size_t shards);
+std::string shard_path(const std::string &manifestPath, std::size_t index);
+
+// Reads the manifest and checks its MAC under cfg's keys; the shards are not opened.
+ShardManifest read_shard_manifest(const std::string &path, const VaultConfig &cfg);
+// Opens and verifies every shard in parallel, checks each against the manifest and merges them
+// into one view, as open_archive does for a single file.
+LoadedArchive open_sharded(const std::string &path, const VaultConfig &cfg);
+// The index of one shard, checked to be the archive the manifest names.
+std::unique_ptr<ArchiveIndex> open_shard_index(const ShardManifest &manifest, std::size_t index, const VaultConfig &cfg);
+
+// Splits `vaults` into `shards` archives and stages them, written in parallel, plus the manifest
+// at outPath (last, so it is renamed into place after its shards).
+void add_sharded(ArchiveBatch &batch, const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                 const std::string &masterKeyHex, const std::vector<std::string> &dependencies, std::size_t shards);
+void write_sharded_file(const std::string &outPath, const std::vector<SealedVault> &vaults, const std::string &token,
+                        const std::string &masterKeyHex, const std::vector<std::string> &dependencies, std::size_t shards);
@@ -1,40 +1,264 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: depend <file.svau>\n";
-        return 1;
-    }
-    std::filesystem::path path(argv[1]);
-    if (!std::filesystem::exists(path)) {
-        std::cerr << "Missing file: " << path << "\n";
-        return 1;
-    }
+namespace {
+enum class Format { Text, Dot, Json };
+
+struct Options {
+    std::vector<std::string> inputs;
+    std::optional<std::string> dir;
+    bool transitive{false};
+    Format format{Format::Text};
+    unsigned jobs{default_jobs()};
+};
+
+void usage() {
+    std::cerr << "Usage: depend <file.svau|dir> [...] [--transitive] [--dir archives/] [--dot|--json] [--jobs n]\n";
+}
+
+// `depends` lines only ever precede the first vault record, so stop there rather than
+// reading the rest of the archive.
+std::set<std::string> read_header(const std::filesystem::path &path) {
     std::ifstream in(path);
-    if (!in) {
-        std::cerr << "Unable to read: " << path << "\n";
-        return 1;
-    }
+    if (!in) throw std::runtime_error("Unable to read: " + path.string());
     std::set<std::string> deps;
     std::string line;
     while (std::getline(in, line)) {
         if (line.rfind("depends ", 0) == 0) {
             deps.insert(line.substr(8));
+            continue;
+        }
+        if (line.rfind("index", 0) == 0 || line.rfind("vault ", 0) == 0 || line.rfind("hmac ", 0) == 0 || line.rfind("segment ", 0) == 0) break;
+    }
+    return deps;
+}
+
+std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+        else if (static_cast<unsigned char>(c) < 0x20) { out += "\\u00"; out.push_back("0123456789abcdef"[(c >> 4) & 0xF]); out.push_back("0123456789abcdef"[c & 0xF]); }
+        else out.push_back(c);
+    }
+    out.push_back('"');
+    return out;
+}
+
+std::string json_array(const std::set<std::string> &vals) {
+    std::string out = "[";
+    bool first = true;
+    for (const auto &v : vals) {
+        if (!first) out += ", ";
+        out += json_string(v);
+        first = false;
+    }
+    return out + "]";
+}
+
+// Archives are named by filename in `depends` lines; the directory is the namespace that
+// resolves them. Every header in it is read in parallel, once.
+struct DependencyIndex {
+    std::map<std::string, std::filesystem::path> paths;
+    std::map<std::string, std::set<std::string>> direct;
+    std::map<std::string, std::string> errors;
+    std::map<std::string, std::set<std::string>> closures;
+
+    void scan(const std::vector<std::filesystem::path> &files, unsigned jobs) {
+        std::vector<std::set<std::string>> heads(files.size());
+        std::vector<std::string> failures(files.size());
+        parallel_for(files.size(), jobs, [&](std::size_t i) {
+            try {
+                heads[i] = read_header(files[i]);
+            } catch (const std::exception &ex) {
+                failures[i] = ex.what();
+            }
+        });
+        for (std::size_t i = 0; i < files.size(); ++i) {
+            auto name = files[i].filename().string();
+            paths[name] = files[i];
+            if (failures[i].empty()) direct[name] = std::move(heads[i]); else errors[name] = failures[i];
         }
     }
 
-    std::cout << "dependencies for " << path.filename().string() << "\n";
-    if (deps.empty()) {
-        std::cout << "(none)\n";
+    // Breadth-first closure that reuses any closure already computed for a reached node;
+    // a memoized closure is always complete, so cycles need no special casing.
+    const std::set<std::string> &closure(const std::string &root) {
+        auto memo = closures.find(root);
+        if (memo != closures.end()) return memo->second;
+        std::set<std::string> seen;
+        std::vector<std::string> frontier{root};
+        while (!frontier.empty()) {
+            auto name = frontier.back();
+            frontier.pop_back();
+            auto known = closures.find(name);
+            if (name != root && known != closures.end()) {
+                seen.insert(known->second.begin(), known->second.end());
+                continue;
+            }
+            auto it = direct.find(name);
+            if (it == direct.end()) continue;
+            for (const auto &dep : it->second) {
+                if (seen.insert(dep).second) frontier.push_back(dep);
+            }
+        }
+        seen.erase(root);
+        return closures[root] = std::move(seen);
+    }
+};
+
+std::vector<std::filesystem::path> archives_in(const std::filesystem::path &dir) {
+    std::vector<std::filesystem::path> files;
+    for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".svau") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--transitive") {
+            opts.transitive = true;
+        } else if (arg == "--dir" && i + 1 < argc) {
+            opts.dir = argv[++i];
+        } else if (arg == "--dot") {
+            opts.format = Format::Dot;
+        } else if (arg == "--json") {
+            opts.format = Format::Json;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (!arg.empty() && arg[0] != '-') {
+            opts.inputs.push_back(arg);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (opts.inputs.empty()) {
+        usage();
+        return 1;
+    }
+
+    DependencyIndex index;
+    std::vector<std::string> roots;
+    try {
+        std::vector<std::filesystem::path> files;
+        for (const auto &input : opts.inputs) {
+            std::filesystem::path path(input);
+            if (!std::filesystem::exists(path)) {
+                std::cerr << "Missing file: " << path << "\n";
+                return 1;
+            }
+            if (std::filesystem::is_directory(path)) {
+                for (auto &f : archives_in(path)) {
+                    roots.push_back(f.filename().string());
+                    files.push_back(std::move(f));
+                }
+                if (!opts.dir) opts.dir = input;
+            } else {
+                roots.push_back(path.filename().string());
+                files.push_back(path);
+            }
+        }
+        if (opts.transitive) {
+            // resolve names against the archive directory (defaults to the first input's)
+            auto dir = opts.dir ? std::filesystem::path(*opts.dir) : files.front().parent_path();
+            if (dir.empty()) dir = ".";
+            auto all = archives_in(dir);
+            std::set<std::filesystem::path> have(all.begin(), all.end());
+            for (const auto &f : files) {
+                auto inDir = dir / f.filename();
+                if (!have.count(inDir)) all.push_back(f);
+            }
+            index.scan(all, opts.jobs);
+        } else {
+            index.scan(files, opts.jobs);
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    for (const auto &root : roots) {
+        auto failed = index.errors.find(root);
+        if (failed != index.errors.end()) {
+            std::cerr << failed->second << "\n";
+            return 1;
+        }
+    }
+
+    auto deps_of = [&](const std::string &name) -> const std::set<std::string> & {
+        return opts.transitive ? index.closure(name) : index.direct[name];
+    };
+    auto missing_of = [&](const std::string &name) {
+        std::set<std::string> missing;
+        if (!opts.transitive) return missing;
+        for (const auto &d : deps_of(name)) {
+            if (!index.paths.count(d)) missing.insert(d);
+        }
+        return missing;
+    };
+
+    if (opts.format == Format::Dot) {
+        // edges are always the direct relation; --transitive only widens the node set
+        std::set<std::string> nodes(roots.begin(), roots.end());
+        if (opts.transitive) {
+            for (const auto &root : roots) {
+                const auto &c = index.closure(root);
+                nodes.insert(c.begin(), c.end());
+            }
+        }
+        std::cout << "digraph depends {\n";
+        for (const auto &node : nodes) {
+            std::cout << "  " << json_string(node) << ";\n";
+            auto it = index.direct.find(node);
+            if (it == index.direct.end()) continue;
+            for (const auto &dep : it->second) std::cout << "  " << json_string(node) << " -> " << json_string(dep) << ";\n";
+        }
+        std::cout << "}\n";
         return 0;
     }
-    for (const auto &d : deps) {
-        std::cout << "- " << d << "\n";
+
+    if (opts.format == Format::Json) {
+        std::cout << "{";
+        bool first = true;
+        for (const auto &root : roots) {
+            std::cout << (first ? "\n  " : ",\n  ") << json_string(root) << ": {\"depends\": " << json_array(index.direct[root]);
+            if (opts.transitive) {
+                std::cout << ", \"transitive\": " << json_array(index.closure(root)) << ", \"missing\": " << json_array(missing_of(root));
+            }
+            std::cout << "}";
+            first = false;
+        }
+        std::cout << "\n}\n";
+        return 0;
+    }
+
+    for (const auto &root : roots) {
+        const auto &deps = deps_of(root);
+        auto missing = missing_of(root);
+        std::cout << (opts.transitive ? "transitive dependencies for " : "dependencies for ") << root << "\n";
+        if (deps.empty()) {
+            std::cout << "(none)\n";
+            continue;
+        }
+        for (const auto &d : deps) {
+            std::cout << "- " << d << (missing.count(d) ? " (missing)" : "") << "\n";
+        }
     }
     return 0;
 }
@@ -0,0 +1,285 @@
+#include "verify.h"
+
+#include "archive.h"
+#include "config.h"
+#include "crypto.h"
+#include "json.h"
+#include "parallel.h"
+#include "shard.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+struct VerifyOptions {
+    std::vector<std::string> targets;
+    unsigned jobs{default_jobs()};
+    bool ndjson{false};
+    bool failuresOnly{false};
+};
+
+struct VerifyResult {
+    std::string path;
+    bool ok{false};
+    std::string detail; // the failure, or a note on a passing archive
+    std::uintmax_t bytes{};
+    long long ms{};
+};
+
+void verify_usage() {
+    std::cerr << "Usage: vaultc verify <dir|archive.svau> [...] [--jobs n] [--failures-only] [--output text|ndjson]\n";
+}
+
+// Archives named on the command line, and every .svau file under each directory, in order.
+// A shard is left to its manifest when both are in the list.
+std::vector<std::string> collect_archives(const std::vector<std::string> &targets) {
+    std::vector<std::string> files;
+    for (const auto &t : targets) {
+        if (!std::filesystem::is_directory(t)) {
+            files.push_back(t);
+            continue;
+        }
+        std::vector<std::string> found;
+        for (const auto &e : std::filesystem::recursive_directory_iterator(t)) {
+            if (e.is_regular_file() && e.path().extension() == ".svau") found.push_back(e.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    std::set<std::string> listed;
+    for (const auto &f : files) listed.insert(std::filesystem::path(f).lexically_normal().string());
+    static const std::regex shardName(R"((.*)\.shard-\d+\.svau)");
+    std::vector<std::string> out;
+    std::set<std::string> seen;
+    for (const auto &f : files) {
+        auto normal = std::filesystem::path(f).lexically_normal().string();
+        if (!seen.insert(normal).second) continue;
+        std::smatch m;
+        if (std::regex_match(normal, m, shardName) && listed.count(m[1].str() + ".svau") && is_shard_manifest(m[1].str() + ".svau")) continue;
+        out.push_back(f);
+    }
+    return out;
+}
+
+// What one pass over an archive file established.
+struct StreamCheck {
+    std::string hmac;           // base trailer, checked
+    std::size_t segments{};     // complete segments, each checked against the chain
+    bool tornSegment{false};    // a trailing segment that was never completed, which readers drop
+};
+
+// Recomputes the base hmac and every segment MAC while reading the file once, line by line, as
+// rekey does: nothing is parsed into a view and no value is decrypted, so memory stays at one
+// line however large the archive is. Throws on the first mismatch.
+StreamCheck check_stream(const std::string &path, const VaultConfig &cfg) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("unable to read");
+    std::string line;
+    if (!std::getline(in, line) || line != "# Vault Secure Archive") throw std::runtime_error("not a vault archive");
+
+    std::vector<std::string> deps;
+    bool haveRecord = false;
+    while (std::getline(in, line)) {
+        if (line.rfind("depends ", 0) == 0) { deps.push_back(line.substr(8)); continue; }
+        if (line.rfind("token ", 0) == 0) {
+            if (line.substr(6) != cfg.token) throw std::runtime_error("token mismatch");
+            continue;
+        }
+        if (line.rfind("index-end ", 0) == 0) { in.ignore(std::stoll(line.substr(10))); continue; }
+        if (line.rfind("vault ", 0) == 0 || line.rfind("hmac ", 0) == 0) { haveRecord = true; break; }
+    }
+    if (!haveRecord) throw std::runtime_error("no records or hmac trailer");
+    auto recordsBase = static_cast<std::uint64_t>(in.tellg()) - line.size() - 1;
+    std::ifstream refs; // second handle for resolving cipher references
+
+    StreamCheck check;
+    auto mac = std::make_unique<crypto::Hmac>(cfg.masterKey);
+    mac->update(archive_mac_preamble(cfg.token, sorted_unique(std::move(deps))));
+    std::string prev;
+    bool inSegment = false;
+    for (bool more = true; more; more = static_cast<bool>(std::getline(in, line))) {
+        // an unterminated last line after the base trailer is a torn append, as in read_svau
+        if (in.eof() && !check.hmac.empty()) {
+            if (!line.empty()) check.tornSegment = true;
+            break;
+        }
+        if (line.empty() && !mac) continue;
+        if (line.rfind("hmac ", 0) == 0) {
+            if (inSegment || !check.hmac.empty()) throw std::runtime_error("misplaced hmac trailer");
+            check.hmac = line.substr(5);
+            if (mac->final() != check.hmac) throw std::runtime_error("HMAC verification failed");
+            prev = check.hmac;
+            mac.reset();
+            continue;
+        }
+        if (line.rfind("segment ", 0) == 0) {
+            if (check.hmac.empty() || inSegment) throw std::runtime_error("segment without a preceding MAC");
+            std::size_t index = 0;
+            auto end = line.data() + line.size();
+            auto parsed = std::from_chars(line.data() + 8, end, index);
+            if (parsed.ec != std::errc() || parsed.ptr != end || index == 0) {
+                // readers discard a malformed segment and everything after it
+                check.tornSegment = true;
+                break;
+            }
+            if (index != check.segments + 1) throw std::runtime_error("segment out of order: " + line.substr(8));
+            mac = std::make_unique<crypto::Hmac>(cfg.masterKey);
+            mac->update("token " + cfg.token + "\n" + line + "\nprev " + prev + "\n");
+            inSegment = true;
+            continue;
+        }
+        if (line.rfind("segment-hmac ", 0) == 0) {
+            if (!inSegment) throw std::runtime_error("misplaced segment-hmac");
+            prev = line.substr(13);
+            if (mac->final() != prev) throw std::runtime_error("segment " + std::to_string(check.segments + 1) + " HMAC verification failed");
+            mac.reset();
+            inSegment = false;
+            check.segments++;
+            continue;
+        }
+        if (!mac) throw std::runtime_error("records after the hmac trailer");
+        if (line.rfind("      cipher @", 0) == 0) {
+            if (!refs.is_open()) refs.open(path, std::ios::binary);
+            line = "      cipher " + resolve_cipher_ref(refs, recordsBase, line.substr(13));
+        }
+        mac->update(line + "\n");
+    }
+    if (check.hmac.empty()) throw std::runtime_error("no hmac trailer (unauthenticated archive)");
+    check.tornSegment = check.tornSegment || inSegment;
+    return check;
+}
+
+void verify_archive(VerifyResult &result, const VaultConfig &cfg) {
+    if (!is_shard_manifest(result.path)) {
+        result.bytes = std::filesystem::file_size(result.path);
+        auto check = check_stream(result.path, cfg);
+        if (check.segments) result.detail = std::to_string(check.segments) + " segment(s)";
+        if (check.tornSegment) result.detail += std::string(result.detail.empty() ? "" : ", ") + "incomplete trailing segment ignored";
+        return;
+    }
+    // the manifest's MAC binds its shard list; each shard must be the exact archive it names
+    auto manifest = read_shard_manifest(result.path, cfg);
+    result.bytes = std::filesystem::file_size(result.path);
+    for (std::size_t i = 0; i < manifest.shards.size(); ++i) {
+        const auto &shard = manifest.shards[i];
+        auto name = std::filesystem::path(shard.path).filename().string();
+        try {
+            result.bytes += std::filesystem::file_size(shard.path);
+            auto check = check_stream(shard.path, cfg);
+            if (check.segments || check.tornSegment || check.hmac != shard.hmac) throw std::runtime_error("does not match the manifest");
+            open_shard_index(manifest, i, cfg);
+        } catch (const std::exception &ex) {
+            throw std::runtime_error("shard " + name + ": " + ex.what());
+        }
+    }
+    result.detail = std::to_string(manifest.shards.size()) + " shard(s)";
+}
+
+void print_result(std::ostream &out, const VerifyResult &r, bool ndjson) {
+    if (ndjson) {
+        std::string line = "{\"path\":";
+        append_json_quoted(line, r.path);
+        line += r.ok ? ",\"status\":\"pass\"" : ",\"status\":\"fail\"";
+        if (!r.detail.empty()) {
+            line += ",\"detail\":";
+            append_json_quoted(line, r.detail);
+        }
+        line += ",\"bytes\":" + std::to_string(r.bytes) + ",\"ms\":" + std::to_string(r.ms) + "}\n";
+        out << line;
+        return;
+    }
+    out << (r.ok ? "PASS " : "FAIL ") << r.path;
+    if (!r.ok) {
+        out << ": " << r.detail << "\n";
+        return;
+    }
+    out << " (" << r.bytes << " bytes, " << r.ms << " ms";
+    if (!r.detail.empty()) out << ", " << r.detail;
+    out << ")\n";
+}
+}
+
+int verify_main(int argc, char **argv) {
+    VerifyOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--failures-only") {
+            opts.failuresOnly = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format != "text" && format != "ndjson") {
+                verify_usage();
+                return 1;
+            }
+            opts.ndjson = format == "ndjson";
+        } else if (!arg.empty() && arg[0] != '-') {
+            opts.targets.push_back(arg);
+        } else {
+            verify_usage();
+            return 1;
+        }
+    }
+    if (opts.targets.empty()) {
+        verify_usage();
+        return 1;
+    }
+
+    std::vector<VerifyResult> results;
+    auto started = std::chrono::steady_clock::now();
+    try {
+        auto cfg = load_config(false);
+        for (auto &path : collect_archives(opts.targets)) {
+            VerifyResult r;
+            r.path = std::move(path);
+            results.push_back(std::move(r));
+        }
+        // each worker holds at most two handles on one archive at a time, so open files stay
+        // bounded by --jobs however many archives there are; results print as they finish
+        std::mutex printMutex;
+        parallel_for(results.size(), opts.jobs, [&](std::size_t i) {
+            auto &r = results[i];
+            auto begin = std::chrono::steady_clock::now();
+            try {
+                verify_archive(r, cfg);
+                r.ok = true;
+            } catch (const std::exception &ex) {
+                r.detail = ex.what();
+            }
+            r.ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+            if (r.ok && opts.failuresOnly) return;
+            std::lock_guard<std::mutex> lock(printMutex);
+            print_result(std::cout, r, opts.ndjson);
+        });
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
+
+    std::size_t failed = 0;
+    std::uintmax_t bytes = 0;
+    for (const auto &r : results) {
+        if (!r.ok) failed++;
+        bytes += r.bytes;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    auto seconds = std::max<long long>(ms, 1) / 1000.0;
+    std::cerr << "verified " << results.size() << " archive(s): " << results.size() - failed << " passed, " << failed << " failed, "
+              << bytes << " bytes in " << ms << " ms (" << static_cast<std::uintmax_t>(results.size() / seconds) << " archives/s, "
+              << static_cast<std::uintmax_t>(bytes / seconds / (1024 * 1024)) << " MiB/s)\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// `vaultc verify`: checks the token and MAC chain of many archives in parallel without
+// decrypting anything. argv[0] is "verify".
+int verify_main(int argc, char **argv);
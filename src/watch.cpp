@@ -0,0 +1,372 @@
+#include "watch.h"
+
+#include "analysis.h"
+#include "archive.h"
+#include "config.h"
+#include "lexer.h"
+#include "parser.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Segments appended before the archive is rewritten from scratch.
+constexpr int kMaxSegments = 32;
+
+struct FileStamp {
+    bool exists{false};
+    std::filesystem::file_time_type mtime{};
+    std::uintmax_t size{};
+
+    bool operator==(const FileStamp &o) const { return exists == o.exists && mtime == o.mtime && size == o.size; }
+    bool operator!=(const FileStamp &o) const { return !(*this == o); }
+};
+
+FileStamp stamp_of(const std::filesystem::path &path) {
+    FileStamp s;
+    std::error_code ec;
+    s.mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) return FileStamp{};
+    s.size = std::filesystem::file_size(path, ec);
+    s.exists = !ec;
+    return s;
+}
+
+// Wakes on changes to a fixed set of files. Their directories are watched rather than the
+// files themselves, since editors commonly save by renaming a new file over the old one.
+// Without inotify the files are polled.
+class FileWatcher {
+  public:
+    explicit FileWatcher(const std::vector<std::filesystem::path> &files) {
+        for (const auto &f : files) {
+            auto abs = std::filesystem::absolute(f).lexically_normal();
+            names_.insert(abs.string());
+            files_.push_back(abs);
+            stamps_.push_back(stamp_of(abs));
+        }
+#ifdef __linux__
+        fd_ = inotify_init1(IN_CLOEXEC);
+        std::map<std::string, int> byDir;
+        for (const auto &f : files_) {
+            if (fd_ < 0) break;
+            auto dir = f.parent_path().string();
+            if (byDir.count(dir)) continue;
+            int wd = inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+            if (wd < 0) {
+                close(fd_);
+                fd_ = -1;
+                break;
+            }
+            byDir[dir] = wd;
+            dirs_[wd] = f.parent_path();
+        }
+#endif
+    }
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    ~FileWatcher() {
+#ifdef __linux__
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    // Blocks until at least one watched file may have changed.
+    void wait() {
+#ifdef __linux__
+        if (fd_ >= 0) {
+            wait_inotify();
+            return;
+        }
+#endif
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            bool changed = false;
+            for (std::size_t i = 0; i < files_.size(); ++i) {
+                auto s = stamp_of(files_[i]);
+                if (s != stamps_[i]) {
+                    stamps_[i] = s;
+                    changed = true;
+                }
+            }
+            if (changed) return;
+        }
+    }
+
+  private:
+#ifdef __linux__
+    void wait_inotify() {
+        alignas(inotify_event) char buf[4096];
+        bool relevant = false;
+        int timeout = -1;
+        for (;;) {
+            pollfd pfd{fd_, POLLIN, 0};
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("watch: poll failed");
+            }
+            if (ready == 0) return;
+            auto n = read(fd_, buf, sizeof(buf));
+            if (n <= 0) continue;
+            for (char *p = buf; p < buf + n;) {
+                auto *ev = reinterpret_cast<inotify_event *>(p);
+                if (ev->len > 0 && dirs_.count(ev->wd) && names_.count((dirs_[ev->wd] / ev->name).string())) relevant = true;
+                p += sizeof(inotify_event) + ev->len;
+            }
+            // saves often arrive as several events; rebuild once things are quiet
+            if (relevant) timeout = 30;
+        }
+    }
+
+    int fd_{-1};
+    std::map<int, std::filesystem::path> dirs_;
+#endif
+    std::vector<std::filesystem::path> files_;
+    std::vector<FileStamp> stamps_;
+    std::set<std::string> names_;
+};
+
+// One top-level block as it appears in the file: a line starting in column 0 and the
+// indented lines under it. Blank lines stay with the preceding block.
+struct Chunk {
+    int firstLine{};
+    std::string text;
+};
+
+std::vector<Chunk> split_blocks(const std::string &source) {
+    std::vector<Chunk> chunks;
+    std::istringstream in(source);
+    std::string line;
+    int number = 1;
+    while (std::getline(in, line)) {
+        bool header = !line.empty() && line[0] != ' ' && line.find_first_not_of(" \r") != std::string::npos;
+        if (header || chunks.empty()) chunks.push_back({number, ""});
+        chunks.back().text += line;
+        chunks.back().text += '\n';
+        number++;
+    }
+    return chunks;
+}
+
+void shift_lines(std::vector<Statement> &body, int delta) {
+    for (auto &s : body) {
+        s.line += delta;
+        if (s.type == StatementType::If) shift_lines(s.conditional.body, delta);
+    }
+}
+
+struct ParsedChunk {
+    int firstLine{};
+    std::vector<VaultBlock> blocks;
+};
+
+struct BlockRef {
+    const VaultBlock *block{};
+    int shift{};
+    const std::string *text{};
+};
+
+class WatchSession {
+  public:
+    explicit WatchSession(const WatchOptions &opts) : opts_(opts) {}
+
+    void rebuild() {
+        auto started = std::chrono::steady_clock::now();
+        auto cfgStamp = stamp_of(std::filesystem::path(".vault") / "var.vc");
+        if (!cfg_ || cfgStamp != cfgStamp_) {
+            cfg_ = load_config(opts_.requireSecurity);
+            cfgStamp_ = cfgStamp;
+            stale_ = true;
+            rewrite_ = true;
+        }
+        if (opts_.loadPath) {
+            auto seedStamp = stamp_of(*opts_.loadPath);
+            if (stale_ || seedStamp != seedStamp_) {
+                seed_ = open_archive(*opts_.loadPath, *cfg_);
+                seedStamp_ = seedStamp;
+                auto deps = seed_.dependencies;
+                deps.push_back(std::filesystem::path(*opts_.loadPath).filename().string());
+                deps = sorted_unique(std::move(deps));
+                if (deps != deps_) rewrite_ = true;
+                deps_ = std::move(deps);
+                stale_ = true;
+            }
+        }
+        if (stamp_of(opts_.output) != outputStamp_) rewrite_ = true;
+
+        std::ifstream in(opts_.input, std::ios::binary);
+        if (!in) throw std::runtime_error("Unable to open file: " + opts_.input);
+        std::ostringstream source;
+        source << in.rdbuf();
+        auto chunks = split_blocks(source.str());
+
+        // re-lex and re-parse only blocks whose text is new; moved blocks just shift lines
+        std::unordered_map<std::string, ParsedChunk> parsed;
+        for (const auto &c : chunks) {
+            if (parsed.count(c.text) || parsed_.count(c.text)) continue;
+            std::istringstream text(c.text);
+            Parser parser(lex_stream(text, c.firstLine));
+            parsed.emplace(c.text, ParsedChunk{c.firstLine, parser.parse()});
+        }
+        auto reparsed = parsed.size();
+        for (const auto &c : chunks) {
+            auto cached = parsed_.find(c.text);
+            if (cached != parsed_.end()) parsed.emplace(c.text, std::move(cached->second));
+        }
+        parsed_ = std::move(parsed);
+
+        std::vector<BlockRef> refs;
+        for (const auto &c : chunks) {
+            const auto &entry = parsed_.at(c.text);
+            for (const auto &b : entry.blocks) refs.push_back({&b, c.firstLine - entry.firstLine, &c.text});
+        }
+
+        // a vault is re-evaluated when the sequence of blocks naming it changed
+        std::map<std::string, GroupState> groups;
+        std::vector<std::size_t> position(refs.size());
+        for (std::size_t i = 0; i < refs.size(); ++i) {
+            auto &g = groups[refs[i].block->name];
+            position[i] = g.texts.size();
+            g.texts.push_back(*refs[i].text);
+        }
+        std::set<std::string> affected;
+        for (auto &g : groups) {
+            auto previous = groups_.find(g.first);
+            if (stale_ || previous == groups_.end() || previous->second.texts != g.second.texts) {
+                affected.insert(g.first);
+            } else {
+                g.second.results = previous->second.results;
+            }
+        }
+
+        std::vector<VaultBlock> program;
+        std::vector<std::size_t> programIndex;
+        for (std::size_t i = 0; i < refs.size(); ++i) {
+            if (!affected.count(refs[i].block->name)) continue;
+            auto block = *refs[i].block;
+            block.line += refs[i].shift;
+            shift_lines(block.body, refs[i].shift);
+            program.push_back(std::move(block));
+            programIndex.push_back(i);
+        }
+        if (opts_.prune) {
+            std::vector<std::string> seeded;
+            for (const auto &v : seed_.vaults) seeded.push_back(v.name);
+            prune_program(program, seeded, opts_.interp.materializeOptional);
+        }
+        auto interpOpts = opts_.interp;
+        interpOpts.forcedMasterKey = cfg_->masterKey;
+        Interpreter interp(interpOpts);
+        if (opts_.loadPath) interp.seed(seed_.vaults);
+        auto slots = interp.evaluate(program);
+        for (std::size_t k = 0; k < slots.size(); ++k) {
+            auto i = programIndex[k];
+            auto &g = groups[refs[i].block->name];
+            g.results.resize(g.texts.size());
+            g.results[position[i]] = std::move(slots[k]);
+        }
+
+        std::vector<SealedVault> sealed;
+        for (std::size_t i = 0; i < refs.size(); ++i) {
+            const auto &slot = groups[refs[i].block->name].results[position[i]];
+            if (slot) sealed.push_back(*slot);
+        }
+
+        std::string action;
+        bool append = !rewrite_ && segments_ < kMaxSegments && segment_expresses(view_, sealed);
+        if (append) {
+            auto delta = diff_vaults(view_, sealed);
+            if (delta.empty()) {
+                action = "no changes";
+            } else {
+                int index = segments_ + 1;
+                auto hmac = compute_segment_hmac(delta, cfg_->token, cfg_->masterKey, index, tail_);
+                append_segment(opts_.output, delta, index, hmac);
+                fold_segment(view_, delta);
+                tail_ = hmac;
+                segments_ = index;
+                action = "appended segment " + std::to_string(index) + " to " + opts_.output;
+            }
+        } else {
+            auto hmac = compute_archive_hmac(sealed, cfg_->token, cfg_->masterKey, deps_);
+            write_svau_file(opts_.output, sealed, cfg_->token, cfg_->masterKey, deps_, hmac);
+            view_ = sealed;
+            tail_ = hmac;
+            segments_ = 0;
+            action = "wrote " + opts_.output;
+        }
+        outputStamp_ = stamp_of(opts_.output);
+        groups_ = std::move(groups);
+        stale_ = false;
+        rewrite_ = false;
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "[watch] re-parsed " << reparsed << " of " << chunks.size() << " block(s), re-evaluated "
+                  << affected.size() << " of " << groups_.size() << " vault(s); " << action << " (" << ms << " ms)\n";
+    }
+
+  private:
+    // Results of one vault's chain of blocks, keyed by the blocks' text.
+    struct GroupState {
+        std::vector<std::string> texts;
+        std::vector<std::optional<SealedVault>> results;
+    };
+
+    WatchOptions opts_;
+    std::optional<VaultConfig> cfg_;
+    FileStamp cfgStamp_;
+    LoadedArchive seed_;
+    FileStamp seedStamp_;
+    std::vector<std::string> deps_;
+    std::unordered_map<std::string, ParsedChunk> parsed_;
+    std::map<std::string, GroupState> groups_;
+    bool stale_{true};   // every vault needs re-evaluating (config or seed changed)
+    bool rewrite_{true}; // the archive on disk can't be extended by a segment
+    // what readers of the output currently see, and its chain position
+    std::vector<SealedVault> view_;
+    std::string tail_;
+    int segments_{0};
+    FileStamp outputStamp_;
+};
+}
+
+int watch_main(const WatchOptions &opts) {
+    if (opts.loadPath && std::filesystem::weakly_canonical(*opts.loadPath) == std::filesystem::weakly_canonical(opts.output)) {
+        std::cerr << "Error: --watch cannot write over its --load archive\n";
+        return 1;
+    }
+    std::vector<std::filesystem::path> files{opts.input, std::filesystem::path(".vault") / "var.vc"};
+    if (opts.loadPath) files.push_back(*opts.loadPath);
+    FileWatcher watcher(files);
+    WatchSession session(opts);
+    std::cout << "[watch] " << opts.input << " -> " << opts.output << " (Ctrl+C to stop)\n";
+    for (;;) {
+        try {
+            session.rebuild();
+        } catch (const std::exception &ex) {
+            std::cerr << "Error: " << ex.what() << "\n";
+        }
+        std::cout.flush();
+        watcher.wait();
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "interpreter.h"
+
+#include <optional>
+#include <string>
+
+struct WatchOptions {
+    std::string input;
+    std::string output;
+    std::optional<std::string> loadPath;
+    InterpreterOptions interp;
+    bool prune{true};
+    bool requireSecurity{false};
+};
+
+// `vaultc <script.vau> --watch`: recompiles whenever the script, its --load archive or
+// .vault/var.vc changes. Only vault blocks whose text changed are re-parsed, only vaults
+// with a changed block are re-evaluated, and unchanged output is extended by an appended
+// segment rather than rewritten. Runs until interrupted.
+int watch_main(const WatchOptions &opts);
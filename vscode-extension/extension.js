@@ -1,4 +1,5 @@
 const vscode = require("vscode");
+const { startLanguageServer } = require("./lsp-client");
 
 /**
  * Provide lightweight keyword/snippet completions for the Vault DSL.
@@ -185,6 +186,13 @@ function activate(context) {
   );
 
   context.subscriptions.push(provider, runCmd, panelCmd, output);
+
+  const serverSetting = vscode.workspace.getConfiguration("vault").get("languageServerPath", "build/vault-lsp");
+  const workspaceRoot = vscode.workspace.workspaceFolders?.[0]?.uri.fsPath;
+  const serverPath = serverSetting && workspaceRoot && !require("path").isAbsolute(serverSetting)
+    ? require("path").join(workspaceRoot, serverSetting)
+    : serverSetting;
+  startLanguageServer(context, serverPath);
 }
 
 function deactivate() {}
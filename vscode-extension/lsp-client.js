@@ -0,0 +1,119 @@
+const vscode = require("vscode");
+const fs = require("fs");
+const { spawn } = require("child_process");
+
+/**
+ * Minimal client for vault-lsp: incremental document sync, diagnostics, hover and
+ * document symbols for .vau scripts. Does nothing when the server binary is not found.
+ */
+function startLanguageServer(context, serverPath) {
+  if (!serverPath || !fs.existsSync(serverPath)) return;
+
+  const child = spawn(serverPath, [], { stdio: ["pipe", "pipe", "ignore"] });
+  const diagnostics = vscode.languages.createDiagnosticCollection("vault");
+  const pending = new Map();
+  let nextId = 1;
+  let buffer = Buffer.alloc(0);
+
+  function send(message) {
+    const body = Buffer.from(JSON.stringify({ jsonrpc: "2.0", ...message }), "utf8");
+    child.stdin.write(`Content-Length: ${body.length}\r\n\r\n`);
+    child.stdin.write(body);
+  }
+
+  function request(method, params) {
+    const id = nextId++;
+    send({ id, method, params });
+    return new Promise(resolve => pending.set(id, resolve));
+  }
+
+  function toRange(r) {
+    return new vscode.Range(r.start.line, r.start.character, r.end.line, r.end.character);
+  }
+
+  function handle(message) {
+    if (message.id !== undefined && pending.has(message.id)) {
+      pending.get(message.id)(message.result);
+      pending.delete(message.id);
+      return;
+    }
+    if (message.method === "textDocument/publishDiagnostics") {
+      const uri = vscode.Uri.parse(message.params.uri);
+      diagnostics.set(uri, message.params.diagnostics.map(d => {
+        const diag = new vscode.Diagnostic(toRange(d.range), d.message, vscode.DiagnosticSeverity.Error);
+        diag.source = d.source;
+        return diag;
+      }));
+    }
+  }
+
+  child.stdout.on("data", chunk => {
+    buffer = Buffer.concat([buffer, chunk]);
+    for (;;) {
+      const headerEnd = buffer.indexOf("\r\n\r\n");
+      if (headerEnd < 0) return;
+      const match = /Content-Length: *(\d+)/i.exec(buffer.slice(0, headerEnd).toString("ascii"));
+      const length = match ? parseInt(match[1], 10) : 0;
+      if (buffer.length < headerEnd + 4 + length) return;
+      const body = buffer.slice(headerEnd + 4, headerEnd + 4 + length).toString("utf8");
+      buffer = buffer.slice(headerEnd + 4 + length);
+      handle(JSON.parse(body));
+    }
+  });
+  child.on("error", () => diagnostics.clear());
+
+  const isScript = doc => doc.languageId === "vault" && doc.fileName.endsWith(".vau");
+  const open = doc => {
+    if (!isScript(doc)) return;
+    send({ method: "textDocument/didOpen", params: { textDocument: { uri: doc.uri.toString(), languageId: "vault", version: doc.version, text: doc.getText() } } });
+  };
+
+  const ready = request("initialize", { processId: process.pid, capabilities: {} }).then(() => {
+    send({ method: "initialized", params: {} });
+    vscode.workspace.textDocuments.forEach(open);
+  });
+
+  context.subscriptions.push(
+    diagnostics,
+    vscode.workspace.onDidOpenTextDocument(doc => ready.then(() => open(doc))),
+    vscode.workspace.onDidChangeTextDocument(event => {
+      if (!isScript(event.document) || event.contentChanges.length === 0) return;
+      ready.then(() => send({
+        method: "textDocument/didChange",
+        params: {
+          textDocument: { uri: event.document.uri.toString(), version: event.document.version },
+          contentChanges: event.contentChanges.map(c => ({
+            range: { start: { line: c.range.start.line, character: c.range.start.character }, end: { line: c.range.end.line, character: c.range.end.character } },
+            text: c.text,
+          })),
+        },
+      }));
+    }),
+    vscode.workspace.onDidCloseTextDocument(doc => {
+      if (isScript(doc)) ready.then(() => send({ method: "textDocument/didClose", params: { textDocument: { uri: doc.uri.toString() } } }));
+    }),
+    vscode.languages.registerHoverProvider({ language: "vault", pattern: "**/*.vau" }, {
+      async provideHover(doc, pos) {
+        await ready;
+        const result = await request("textDocument/hover", { textDocument: { uri: doc.uri.toString() }, position: { line: pos.line, character: pos.character } });
+        if (!result) return undefined;
+        return new vscode.Hover(new vscode.MarkdownString(result.contents.value), toRange(result.range));
+      },
+    }),
+    vscode.languages.registerDocumentSymbolProvider({ language: "vault", pattern: "**/*.vau" }, {
+      async provideDocumentSymbols(doc) {
+        await ready;
+        const result = await request("textDocument/documentSymbol", { textDocument: { uri: doc.uri.toString() } });
+        const convert = s => {
+          const sym = new vscode.DocumentSymbol(s.name, s.detail || "", s.kind - 1, toRange(s.range), toRange(s.selectionRange));
+          sym.children = (s.children || []).map(convert);
+          return sym;
+        };
+        return (result || []).map(convert);
+      },
+    }),
+    { dispose: () => { send({ id: nextId++, method: "shutdown" }); send({ method: "exit" }); } }
+  );
+}
+
+module.exports = { startLanguageServer };